@@ -0,0 +1,169 @@
+/* 6502.c
+ * 6502/65C02 module for DisPel
+ * Disassembles code for the 65816's 8-bit forebears, as found on the NES
+ * and in the Apple IIgs' emulation-mode code. The opcodes they share with
+ * the 65816 go through disasm().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+/* Instruction lengths on the NMOS 6502 and the 65C02 (with the Rockwell/WDC
+ * bit instructions), 0 where there's no instruction. BRK is one byte here.
+ */
+
+static const unsigned char len6502[2][256] =
+{
+	{
+		1, 2, 0, 0, 0, 2, 2, 0, 1, 2, 1, 0, 0, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+		3, 2, 0, 0, 2, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+		1, 2, 0, 0, 0, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+		1, 2, 0, 0, 0, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+		0, 2, 0, 0, 2, 2, 2, 0, 1, 0, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 2, 2, 2, 0, 1, 3, 1, 0, 0, 3, 0, 0,
+		2, 2, 2, 0, 2, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 2, 2, 2, 0, 1, 3, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 2, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+		2, 2, 0, 0, 2, 2, 2, 0, 1, 2, 1, 0, 3, 3, 3, 0,
+		2, 2, 0, 0, 0, 2, 2, 0, 1, 3, 0, 0, 0, 3, 3, 0,
+	},
+	{
+		1, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 3, 1, 0, 3, 3, 3, 3,
+		3, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 3, 1, 0, 3, 3, 3, 3,
+		1, 2, 0, 0, 0, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 0, 2, 2, 2, 1, 3, 1, 0, 0, 3, 3, 3,
+		1, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 3, 1, 0, 3, 3, 3, 3,
+		2, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 3, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 2, 2, 2, 2, 1, 3, 1, 0, 3, 3, 3, 3,
+		2, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 1, 3, 3, 3, 3,
+		2, 2, 2, 0, 0, 2, 2, 2, 1, 3, 1, 1, 0, 3, 3, 3,
+		2, 2, 0, 0, 2, 2, 2, 2, 1, 2, 1, 0, 3, 3, 3, 3,
+		2, 2, 2, 0, 0, 2, 2, 2, 1, 3, 1, 0, 0, 3, 3, 3,
+	}
+};
+
+/* reset6502() - state reset: always 8-bit, and emulation mode to disasm() */
+
+unsigned short reset6502(unsigned short flag)
+{
+	return FLAG_E | 0x30;
+}
+
+/* walk() - walks instruction boundaries, as scan() does */
+
+static unsigned long walk(const unsigned char *lens, unsigned char *data, unsigned long rpos,
+	unsigned long end, unsigned char *marks)
+{
+	while (rpos < end)
+	{
+		if (marks != NULL)
+		{
+			marks[rpos] |= CM_OP;
+		}
+		// Bytes that aren't instructions are skipped one at a time
+		rpos += lens[data[rpos]] ? lens[data[rpos]] : 1;
+	}
+	return rpos;
+}
+
+unsigned long scan6502(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks)
+{
+	return walk(len6502[0], data, rpos, end, marks);
+}
+
+unsigned long scan65c02(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks)
+{
+	return walk(len6502[1], data, rpos, end, marks);
+}
+
+/* decode() - disassembles a single 6502/65C02 instruction
+ * Pre:  cmos - 1 for the 65C02
+ *       otherwise as for disasm()
+ * Post: inst - disassembled instruction; bytes that aren't instructions
+ *       are output as db.
+ *       returns number of bytes to advance, or 0 if truncated.
+ */
+
+static int decode(unsigned char *mem, unsigned long avail, unsigned long pos, char *inst, unsigned char tsrc,
+	int cmos)
+{
+	char name[8],pbuf[16];
+	unsigned short f = FLAG_E | 0x30;
+	int offset,sval;
+
+	if (avail == 0)
+	{
+		return 0;
+	}
+	offset = len6502[cmos][mem[0]];
+	if ((unsigned long)offset > avail)
+	{
+		return 0;
+	}
+	if (offset == 0)
+	{
+		if (tsrc & 4)
+		{
+			sprintf(inst, "db $%02X", mem[0]);
+			return 1;
+		}
+		sprintf(pbuf, "$%02X", mem[0]);
+		fmtline(mem, pos, 1, "db", pbuf, inst, tsrc);
+		return 1;
+	}
+
+	// BRK has no signature byte
+	if (mem[0] == 0x00)
+	{
+		fmtline(mem, pos, 1, "brk", "", inst, tsrc);
+		return 1;
+	}
+
+	// RMB/SMB and BBR/BBS
+	if (cmos && (mem[0] & 0x07) == 0x07)
+	{
+		sprintf(name, "%s%d", (mem[0] & 0x08) ? ((mem[0] & 0x80) ? "bbs" : "bbr") : ((mem[0] & 0x80) ? "smb" : "rmb"),
+			(mem[0] >> 4) & 7);
+		if (mem[0] & 0x08)
+		{
+			sval = (mem[2]>127) ? (mem[2]-256) : mem[2];
+			sprintf(pbuf, "$%02X,$%04lX", mem[1], (pos+sval+3) & 0xFFFF);
+		}
+		else
+		{
+			sprintf(pbuf, "$%02X", mem[1]);
+		}
+		fmtline(mem, pos, offset, name, pbuf, inst, tsrc);
+		return offset;
+	}
+
+	// Everything else is the same on the 65816 in emulation mode
+	return disasm(mem, avail, pos, &f, inst, tsrc);
+}
+
+int dis6502(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc)
+{
+	return decode(mem, avail, pos, inst, tsrc, 0);
+}
+
+int dis65c02(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc)
+{
+	return decode(mem, avail, pos, inst, tsrc, 1);
+}
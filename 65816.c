@@ -11,981 +11,382 @@
 
 #include "dispel.h"
 
-/* disasm() - disassembles a single instruction
- * Pre:  mem   - pointer to memory for disassembly
- *       pos   - "address" of the instruction
- *       inst  - pointer to string buffer
- *       flag  - current processor state
- *       tsrc  - 1 if addresses/hex dump is to be suppressed.
- * Post: inst  - disassembled instruction
- *       returns number of bytes to advance, or 0 for error.
+/* Instruction lengths for each M/X state, indexed by OPSTATE(flag) then
+ * opcode. LM/LX are the lengths of the A and X/Y sized immediates.
  */
 
-int disasm(unsigned char *mem, unsigned long pos, unsigned char *flag, char *inst, unsigned char tsrc)
+#define OPLENS(LM,LX) { \
+	2,2,2,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	3,2,4,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	1,2,2,2,3,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,3,2,2,2,1,3,1,1,4,3,3,4, \
+	1,2,3,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	2,2,3,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	LX,2,LX,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	LX,2,2,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,2,2,2,2,1,3,1,1,3,3,3,4, \
+	LX,2,2,2,2,2,2,2,1,LM,1,1,3,3,3,4, \
+	2,2,2,2,3,2,2,2,1,3,1,1,3,3,3,4 }
+
+const unsigned char oplen[4][256] =
 {
-	// temp buffers to hold instruction,parameters and hex
-	char ibuf[5],pbuf[20],hbuf[9];
-	// variables to hold the instruction increment and signed params
-	int offset,sval,i;
+	OPLENS(3,3),	// 16-bit A, 16-bit X/Y
+	OPLENS(3,2),	// 16-bit A, 8-bit X/Y
+	OPLENS(2,3),	// 8-bit A, 16-bit X/Y
+	OPLENS(2,2)		// 8-bit A, 8-bit X/Y
+};
 
-	// Parse out instruction mnemonic
+/* stepflag() - tracks the processor state across one instruction
+ * Pre:  mem   - pointer to the instruction
+ *       avail - bytes at mem that can be read
+ *       flag  - processor state before it
+ * Post: flag  - processor state after it. REP/SEP, CLC/SEC and XCE are
+ *       followed; emulation mode forces 8-bit registers. A REP/SEP cut
+ *       off before its operand changes nothing.
+ *       returns 1 if the M/X/E state changed.
+ */
+
+int stepflag(unsigned char *mem, unsigned long avail, unsigned short *flag)
+{
+	unsigned short f = *flag;
+	int changed;
 
+	if (avail == 0)
+	{
+		return 0;
+	}
 	switch (mem[0])
 	{
-		// ADC
-	case 0x69:
-	case 0x6D:
-	case 0x6F:
-	case 0x65:
-	case 0x72:
-	case 0x67:
-	case 0x7D:
-	case 0x7F:
-	case 0x79:
-	case 0x75:
-	case 0x61:
-	case 0x71:
-	case 0x77:
-	case 0x63:
-	case 0x73:
-		strcpy(ibuf,"adc");
-		break;
-		// AND
-	case 0x29:
-	case 0x2D:
-	case 0x2F:
-	case 0x25:
-	case 0x32:
-	case 0x27:
-	case 0x3D:
-	case 0x3F:
-	case 0x39:
-	case 0x35:
-	case 0x21:
-	case 0x31:
-	case 0x37:
-	case 0x23:
-	case 0x33:
-		strcpy(ibuf,"and");
-		break;
-		// ASL
-	case 0x0A:
-	case 0x0E:
-	case 0x06:
-	case 0x1E:
-	case 0x16:
-		strcpy(ibuf,"asl");
-		break;
-		// BCC
-	case 0x90:
-		strcpy(ibuf,"bcc");
-		break;
-		// BCS
-	case 0xB0:
-		strcpy(ibuf,"bcs");
-		break;
-		// BEQ
-	case 0xF0:
-		strcpy(ibuf,"beq");
-		break;
-		// BNE
-	case 0xD0:
-		strcpy(ibuf,"bne");
-		break;
-		// BMI
-	case 0x30:
-		strcpy(ibuf,"bmi");
-		break;
-		// BPL
-	case 0x10:
-		strcpy(ibuf,"bpl");
-		break;
-		// BVC
-	case 0x50:
-		strcpy(ibuf,"bvc");
-		break;
-		// BVS
-	case 0x70:
-		strcpy(ibuf,"bvs");
-		break;
-		// BRA
-	case 0x80:
-		strcpy(ibuf,"bra");
-		break;
-		// BRL
-	case 0x82:
-		strcpy(ibuf,"brl");
-		break;
-		// BIT
-	case 0x89:
-	case 0x2C:
-	case 0x24:
-	case 0x3C:
-	case 0x34:
-		strcpy(ibuf,"bit");
-		break;
-		// BRK
-	case 0x00:
-		strcpy(ibuf,"brk");
-		break;
-		// CLC
-	case 0x18:
-		strcpy(ibuf,"clc");
-		break;
-		// CLD
-	case 0xD8:
-		strcpy(ibuf,"cld");
-		break;
-		// CLI
-	case 0x58:
-		strcpy(ibuf,"cli");
-		break;
-		// CLV
-	case 0xB8:
-		strcpy(ibuf,"clv");
-		break;
-		// SEC
-	case 0x38:
-		strcpy(ibuf,"sec");
-		break;
-		// SED
-	case 0xF8:
-		strcpy(ibuf,"sed");
-		break;
-		// SEI
-	case 0x78:
-		strcpy(ibuf,"sei");
-		break;
-		// CMP
-	case 0xC9:
-	case 0xCD:
-	case 0xCF:
-	case 0xC5:
-	case 0xD2:
-	case 0xC7:
-	case 0xDD:
-	case 0xDF:
-	case 0xD9:
-	case 0xD5:
-	case 0xC1:
-	case 0xD1:
-	case 0xD7:
-	case 0xC3:
-	case 0xD3:
-		strcpy(ibuf,"cmp");
-		break;
-		// COP
-	case 0x02:
-		strcpy(ibuf,"cop");
-		break;
-		// CPX
-	case 0xE0:
-	case 0xEC:
-	case 0xE4:
-		strcpy(ibuf,"cpx");
-		break;
-		// CPY
-	case 0xC0:
-	case 0xCC:
-	case 0xC4:
-		strcpy(ibuf,"cpy");
-		break;
-		// DEC
-	case 0x3A:
-	case 0xCE:
-	case 0xC6:
-	case 0xDE:
-	case 0xD6:
-		strcpy(ibuf,"dec");
-		break;
-		// DEX
-	case 0xCA:
-		strcpy(ibuf,"dex");
-		break;
-		// DEY
-	case 0x88:
-		strcpy(ibuf,"dey");
-		break;
-		// EOR
-	case 0x49:
-	case 0x4D:
-	case 0x4F:
-	case 0x45:
-	case 0x52:
-	case 0x47:
-	case 0x5D:
-	case 0x5F:
-	case 0x59:
-	case 0x55:
-	case 0x41:
-	case 0x51:
-	case 0x57:
-	case 0x43:
-	case 0x53:
-		strcpy(ibuf,"eor");
-		break;
-		// INC
-	case 0x1A:
-	case 0xEE:
-	case 0xE6:
-	case 0xFE:
-	case 0xF6:
-		strcpy(ibuf,"inc");
-		break;
-		// INX
-	case 0xE8:
-		strcpy(ibuf,"inx");
-		break;
-		// INY
-	case 0xC8:
-		strcpy(ibuf,"iny");
-		break;
-		// JMP
-	case 0x4C:
-	case 0x6C:
-	case 0x7C:
-	case 0x5C:
-	case 0xDC:
-		strcpy(ibuf,"jmp");
-		break;
-		// JSR
-	case 0x22:
-	case 0x20:
-	case 0xFC:
-		strcpy(ibuf,"jsr");
-		break;
-		// LDA
-	case 0xA9:
-	case 0xAD:
-	case 0xAF:
-	case 0xA5:
-	case 0xB2:
-	case 0xA7:
-	case 0xBD:
-	case 0xBF:
-	case 0xB9:
-	case 0xB5:
-	case 0xA1:
-	case 0xB1:
-	case 0xB7:
-	case 0xA3:
-	case 0xB3:
-		strcpy(ibuf,"lda");
-		break;
-		// LDX
-	case 0xA2:
-	case 0xAE:
-	case 0xA6:
-	case 0xBE:
-	case 0xB6:
-		strcpy(ibuf,"ldx");
-		break;
-		// LDY
-	case 0xA0:
-	case 0xAC:
-	case 0xA4:
-	case 0xBC:
-	case 0xB4:
-		strcpy(ibuf,"ldy");
-		break;
-		// LSR
-	case 0x4A:
-	case 0x4E:
-	case 0x46:
-	case 0x5E:
-	case 0x56:
-		strcpy(ibuf,"lsr");
-		break;
-		// MVN
-	case 0x54:
-		strcpy(ibuf,"mvn");
-		break;
-		// MVP
-	case 0x44:
-		strcpy(ibuf,"mvp");
-		break;
-		// NOP
-	case 0xEA:
-		strcpy(ibuf,"nop");
-		break;
-		// ORA
-	case 0x09:
-	case 0x0D:
-	case 0x0F:
-	case 0x05:
-	case 0x12:
-	case 0x07:
-	case 0x1D:
-	case 0x1F:
-	case 0x19:
-	case 0x15:
-	case 0x01:
-	case 0x11:
-	case 0x17:
-	case 0x03:
-	case 0x13:
-		strcpy(ibuf,"ora");
-		break;
-		// PEA
-	case 0xF4:
-		strcpy(ibuf,"pea");
-		break;
-		// PEI
-	case 0xD4:
-		strcpy(ibuf,"pei");
-		break;
-		// PER
-	case 0x62:
-		strcpy(ibuf,"per");
-		break;
-		// PHA
-	case 0x48:
-		strcpy(ibuf,"pha");
-		break;
-		// PHP
-	case 0x08:
-		strcpy(ibuf,"php");
-		break;
-		// PHX
-	case 0xDA:
-		strcpy(ibuf,"phx");
-		break;
-		// PHY
-	case 0x5A:
-		strcpy(ibuf,"phy");
-		break;
-		// PLA
-	case 0x68:
-		strcpy(ibuf,"pla");
-		break;
-		// PLP
-	case 0x28:
-		strcpy(ibuf,"plp");
-		break;
-		// PLX
-	case 0xFA:
-		strcpy(ibuf,"plx");
-		break;
-		// PLY
-	case 0x7A:
-		strcpy(ibuf,"ply");
-		break;
-		// PHB
-	case 0x8B:
-		strcpy(ibuf,"phb");
-		break;
-		// PHD
-	case 0x0B:
-		strcpy(ibuf,"phd");
-		break;
-		// PHK
-	case 0x4B:
-		strcpy(ibuf,"phk");
-		break;
-		// PLB
-	case 0xAB:
-		strcpy(ibuf,"plb");
-		break;
-		// PLD
-	case 0x2B:
-		strcpy(ibuf,"pld");
-		break;
 		// REP
 	case 0xC2:
-		strcpy(ibuf,"rep");
-		break;
-		// ROL
-	case 0x2A:
-	case 0x2E:
-	case 0x26:
-	case 0x3E:
-	case 0x36:
-		strcpy(ibuf,"rol");
-		break;
-		// ROR
-	case 0x6A:
-	case 0x6E:
-	case 0x66:
-	case 0x7E:
-	case 0x76:
-		strcpy(ibuf,"ror");
-		break;
-		// RTI
-	case 0x40:
-		strcpy(ibuf,"rti");
-		if(tsrc&0x2)
-			strcat(ibuf,"\n");
-		break;
-		// RTL
-	case 0x6B:
-		strcpy(ibuf,"rtl");
-		if(tsrc&0x2)
-			strcat(ibuf,"\n");
-		break;
-		// RTS
-	case 0x60:
-		strcpy(ibuf,"rts");
-		if(tsrc&0x2)
-			strcat(ibuf,"\n");
-		break;
-		// SBC
-	case 0xE9:
-	case 0xED:
-	case 0xEF:
-	case 0xE5:
-	case 0xF2:
-	case 0xE7:
-	case 0xFD:
-	case 0xFF:
-	case 0xF9:
-	case 0xF5:
-	case 0xE1:
-	case 0xF1:
-	case 0xF7:
-	case 0xE3:
-	case 0xF3:
-		strcpy(ibuf,"sbc");
+		if (avail < 2)
+		{
+			return 0;
+		}
+		f &= ~mem[1];
 		break;
 		// SEP
 	case 0xE2:
-		strcpy(ibuf,"sep");
-		break;
-		// STA
-	case 0x8D:
-	case 0x8F:
-	case 0x85:
-	case 0x92:
-	case 0x87:
-	case 0x9D:
-	case 0x9F:
-	case 0x99:
-	case 0x95:
-	case 0x81:
-	case 0x91:
-	case 0x97:
-	case 0x83:
-	case 0x93:
-		strcpy(ibuf,"sta");
-		break;
-		// STP
-	case 0xDB:
-		strcpy(ibuf,"stp");
-		break;
-		// STX
-	case 0x8E:
-	case 0x86:
-	case 0x96:
-		strcpy(ibuf,"stx");
-		break;
-		// STY
-	case 0x8C:
-	case 0x84:
-	case 0x94:
-		strcpy(ibuf,"sty");
-		break;
-		// STZ
-	case 0x9C:
-	case 0x64:
-	case 0x9E:
-	case 0x74:
-		strcpy(ibuf,"stz");
-		break;
-		// TAX
-	case 0xAA:
-		strcpy(ibuf,"tax");
-		break;
-		// TAY
-	case 0xA8:
-		strcpy(ibuf,"tay");
-		break;
-		// TXA
-	case 0x8A:
-		strcpy(ibuf,"txa");
-		break;
-		// TYA
-	case 0x98:
-		strcpy(ibuf,"tya");
-		break;
-		// TSX
-	case 0xBA:
-		strcpy(ibuf,"tsx");
-		break;
-		// TXS
-	case 0x9A:
-		strcpy(ibuf,"txs");
-		break;
-		// TXY
-	case 0x9B:
-		strcpy(ibuf,"txy");
-		break;
-		// TYX
-	case 0xBB:
-		strcpy(ibuf,"tyx");
-		break;
-		// TCD
-	case 0x5B:
-		strcpy(ibuf,"tcd");
-		break;
-		// TDC
-	case 0x7B:
-		strcpy(ibuf,"tdc");
-		break;
-		// TCS
-	case 0x1B:
-		strcpy(ibuf,"tcs");
-		break;
-		// TSC
-	case 0x3B:
-		strcpy(ibuf,"tsc");
-		break;
-		// TRB
-	case 0x1C:
-	case 0x14:
-		strcpy(ibuf,"trb");
-		break;
-		// TSB
-	case 0x0C:
-	case 0x04:
-		strcpy(ibuf,"tsb");
-		break;
-		// WAI
-	case 0xCB:
-		strcpy(ibuf,"wai");
+		if (avail < 2)
+		{
+			return 0;
+		}
+		f |= mem[1];
 		break;
-		// WDM
-	case 0x42:
-		strcpy(ibuf,"wdm");
+		// CLC
+	case 0x18:
+		f &= ~0x01;
 		break;
-		// XBA
-	case 0xEB:
-		strcpy(ibuf,"xba");
+		// SEC
+	case 0x38:
+		f |= 0x01;
 		break;
-		// XCE
+		// XCE swaps carry and emulation
 	case 0xFB:
-		strcpy(ibuf,"xce");
+		// (leaving emulation mode finds M/X already set, as below)
+		f = (f & ~(0x01|FLAG_E)) | ((f & 0x01) ? FLAG_E : 0) | ((f & FLAG_E) ? 0x01 : 0);
 		break;
 	default:
-		// Illegal
-		printf("Unhandled instruction: %02X\n",mem[0]);
-		exit(1);
-	};
+		return 0;
+	}
+
+	if (f & FLAG_E)
+	{
+		f |= 0x30;
+	}
+	changed = ((f ^ *flag) & (0x30|FLAG_E)) != 0;
+	*flag = f;
+	return changed;
+}
+
+/* Addressing mode of each opcode, see AM_* */
+
+const unsigned char opmode[256] =
+{
+	AM_SIG, AM_DPINDX, AM_SIG, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_ACC, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DP, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_ACC, AM_IMP, AM_ABS, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_ABS, AM_DPINDX, AM_LONG, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_ACC, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DPX, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_ACC, AM_IMP, AM_ABSX, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_IMP, AM_DPINDX, AM_SIG, AM_SR, AM_MOVE, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_ACC, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_MOVE, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_LONG, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_IMP, AM_DPINDX, AM_RELL, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_ACC, AM_IMP, AM_ABSIND, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DPX, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_ABSINDX, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_REL, AM_DPINDX, AM_RELL, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_IMP, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DPX, AM_DPX, AM_DPY, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_ABS, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_IMMX, AM_DPINDX, AM_IMMX, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_IMP, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DPX, AM_DPX, AM_DPY, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_ABSX, AM_ABSX, AM_ABSY, AM_LONGX,
+	AM_IMMX, AM_DPINDX, AM_IMM8, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_IMP, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_DPIND, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_ABSINDL, AM_ABSX, AM_ABSX, AM_LONGX,
+	AM_IMMX, AM_DPINDX, AM_IMM8, AM_SR, AM_DP, AM_DP, AM_DP, AM_DPINDL, AM_IMP, AM_IMMM, AM_IMP, AM_IMP, AM_ABS, AM_ABS, AM_ABS, AM_LONG,
+	AM_REL, AM_DPINDY, AM_DPIND, AM_SRINDY, AM_STKABS, AM_DPX, AM_DPX, AM_DPINDLY, AM_IMP, AM_ABSY, AM_IMP, AM_IMP, AM_ABSINDX, AM_ABSX, AM_ABSX, AM_LONGX,
+};
+
+/* Mnemonic of each opcode */
+
+const char opname[256][4] =
+{
+	"brk", "ora", "cop", "ora", "tsb", "ora", "asl", "ora", "php", "ora", "asl", "phd", "tsb", "ora", "asl", "ora",
+	"bpl", "ora", "ora", "ora", "trb", "ora", "asl", "ora", "clc", "ora", "inc", "tcs", "trb", "ora", "asl", "ora",
+	"jsr", "and", "jsr", "and", "bit", "and", "rol", "and", "plp", "and", "rol", "pld", "bit", "and", "rol", "and",
+	"bmi", "and", "and", "and", "bit", "and", "rol", "and", "sec", "and", "dec", "tsc", "bit", "and", "rol", "and",
+	"rti", "eor", "wdm", "eor", "mvp", "eor", "lsr", "eor", "pha", "eor", "lsr", "phk", "jmp", "eor", "lsr", "eor",
+	"bvc", "eor", "eor", "eor", "mvn", "eor", "lsr", "eor", "cli", "eor", "phy", "tcd", "jmp", "eor", "lsr", "eor",
+	"rts", "adc", "per", "adc", "stz", "adc", "ror", "adc", "pla", "adc", "ror", "rtl", "jmp", "adc", "ror", "adc",
+	"bvs", "adc", "adc", "adc", "stz", "adc", "ror", "adc", "sei", "adc", "ply", "tdc", "jmp", "adc", "ror", "adc",
+	"bra", "sta", "brl", "sta", "sty", "sta", "stx", "sta", "dey", "bit", "txa", "phb", "sty", "sta", "stx", "sta",
+	"bcc", "sta", "sta", "sta", "sty", "sta", "stx", "sta", "tya", "sta", "txs", "txy", "stz", "sta", "stz", "sta",
+	"ldy", "lda", "ldx", "lda", "ldy", "lda", "ldx", "lda", "tay", "lda", "tax", "plb", "ldy", "lda", "ldx", "lda",
+	"bcs", "lda", "lda", "lda", "ldy", "lda", "ldx", "lda", "clv", "lda", "tsx", "tyx", "ldy", "lda", "ldx", "lda",
+	"cpy", "cmp", "rep", "cmp", "cpy", "cmp", "dec", "cmp", "iny", "cmp", "dex", "wai", "cpy", "cmp", "dec", "cmp",
+	"bne", "cmp", "cmp", "cmp", "pei", "cmp", "dec", "cmp", "cld", "cmp", "phx", "stp", "jmp", "cmp", "dec", "cmp",
+	"cpx", "sbc", "sep", "sbc", "cpx", "sbc", "inc", "sbc", "inx", "sbc", "nop", "xba", "cpx", "sbc", "inc", "sbc",
+	"beq", "sbc", "sbc", "sbc", "pea", "sbc", "inc", "sbc", "sed", "sbc", "plx", "xce", "jsr", "sbc", "inc", "sbc",
+};
+
+/* mnemonic() - name to output for an opcode
+ * Pre:  tsrc - output flags, as for disasm()
+ * Post: returns the mnemonic. In assembler source, the long call and
+ *       jumps get their own names rather than sharing JSR/JMP's.
+ */
+
+const char *mnemonic(unsigned char op, unsigned char tsrc)
+{
+	if (tsrc & 4)
+	{
+		switch (op)
+		{
+		case 0x22:
+			return "jsl";
+		case 0x5C:
+		case 0xDC:
+			return "jml";
+		}
+	}
+	return opname[op];
+}
+
+/* scan() - walks instruction boundaries without decoding them
+ * Pre:  data  - ROM image
+ *       rpos  - file offset to start at
+ *       end   - file offset to stop before, at most the image length
+ *       flag  - processor state at rpos
+ *       marks - optional code map to set CM_OP (and the M/X bits) in
+ * Post: flag  - processor state at the returned offset
+ *       returns the offset of the first instruction at or after end.
+ *       The length table is only re-selected when the state changes.
+ */
+
+unsigned long scan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks)
+{
+	const unsigned char *lens = oplen[OPSTATE(*flag)];
+	unsigned char op;
+	unsigned short f = *flag;
+
+	while (rpos < end)
+	{
+		op = data[rpos];
+		if (marks != NULL)
+		{
+			marks[rpos] |= CM_OP | (f & 0x30) | ((f & FLAG_E) ? CM_EMU : 0);
+		}
+		if (stepflag(data+rpos, end-rpos, &f))
+		{
+			lens = oplen[OPSTATE(f)];
+		}
+		rpos += lens[op];
+	}
+
+	*flag = f;
+	return rpos;
+}
+
+/* disasm() - disassembles a single instruction
+ * Pre:  mem   - pointer to memory for disassembly
+ *       avail - bytes at mem that can be read
+ *       pos   - "address" of the instruction
+ *       inst  - pointer to string buffer
+ *       flag  - current processor state (P, plus FLAG_E)
+ *       tsrc  - 1 if addresses/hex dump is to be suppressed, 2 to split
+ *               subroutines, 4 for assembler source (width hints, long
+ *               branch targets, JSL/JML).
+ * Post: inst  - disassembled instruction
+ *       returns number of bytes to advance, or 0 if the instruction is
+ *       truncated - longer than avail - in which case nothing past avail
+ *       is read and inst and flag are left alone.
+ */
+
+int disasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc)
+{
+	// temp buffers to hold instruction,parameters and hex
+	char ibuf[8],pbuf[20],hbuf[9];
+	// variables to hold the instruction increment and signed params
+	int offset,sval,i;
+	unsigned long target;
+
+	// Instruction length comes straight from the table for the current M/X state
+	if (avail == 0 || (offset = oplen[OPSTATE(*flag)][mem[0]]) > avail)
+	{
+		return 0;
+	}
+
+	// Parse out instruction mnemonic
+	strcpy(ibuf, mnemonic(mem[0], tsrc));
+	if ((tsrc & 2) && (mem[0] == 0x40 || mem[0] == 0x60 || mem[0] == 0x6B))
+	{
+		strcat(ibuf, "\n");
+	}
 
 	// Parse out parameter list
-	switch(mem[0]){
-		// Absolute
-	case 0x0C:
-	case 0x0D:
-	case 0x0E:
-	case 0x1C:
-	case 0x20:
-	case 0x2C:
-	case 0x2D:
-	case 0x2E:
-	case 0x4C:
-	case 0x4D:
-	case 0x4E:
-	case 0x6D:
-	case 0x6E:
-	case 0x8C:
-	case 0x8D:
-	case 0x8E:
-	case 0x9C:
-	case 0xAC:
-	case 0xAD:
-	case 0xAE:
-	case 0xCC:
-	case 0xCD:
-	case 0xCE:
-	case 0xEC:
-	case 0xED:
-	case 0xEE:
+	switch(opmode[mem[0]]){
+	case AM_ABS:
+	case AM_STKABS:
 		sprintf(pbuf,"$%04X",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Indexed Indirect
-	case 0x7C:
-	case 0xFC:
+	case AM_ABSINDX:
 		sprintf(pbuf,"($%04X,X)",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Indexed, X
-	case 0x1D:
-	case 0x1E:
-	case 0x3C:
-	case 0x3D:
-	case 0x3E:
-	case 0x5D:
-	case 0x5E:
-	case 0x7D:
-	case 0x7E:
-	case 0x9D:
-	case 0x9E:
-	case 0xBC:
-	case 0xBD:
-	case 0xDD:
-	case 0xDE:
-	case 0xFD:
-	case 0xFE:
+	case AM_ABSX:
 		sprintf(pbuf,"$%04X,X",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Indexed, Y
-	case 0x19:
-	case 0x39:
-	case 0x59:
-	case 0x79:
-	case 0x99:
-	case 0xB9:
-	case 0xBE:
-	case 0xD9:
-	case 0xF9:
+	case AM_ABSY:
 		sprintf(pbuf,"$%04X,Y",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Indirect
-	case 0x6C:
+	case AM_ABSIND:
 		sprintf(pbuf,"($%04X)",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Indirect Long
-	case 0xDC:
+	case AM_ABSINDL:
 		sprintf(pbuf,"[$%04X]",mem[1]+mem[2]*256);
-		offset=3;
 		break;
-		// Absolute Long
-	case 0x0F:
-	case 0x22:
-	case 0x2F:
-	case 0x4F:
-	case 0x5C:
-	case 0x6F:
-	case 0x8F:
-	case 0xAF:
-	case 0xCF:
-	case 0xEF:
+	case AM_LONG:
 		sprintf(pbuf,"$%06X",mem[1]+mem[2]*256+mem[3]*65536);
-		offset=4;
 		break;
-		// Absolute Long Indexed, X
-	case 0x1F:
-	case 0x3F:
-	case 0x5F:
-	case 0x7F:
-	case 0x9F:
-	case 0xBF:
-	case 0xDF:
-	case 0xFF:
+	case AM_LONGX:
 		sprintf(pbuf,"$%06X,X",mem[1]+mem[2]*256+mem[3]*65536);
-		offset=4;
 		break;
-		// Accumulator
-	case 0x0A:
-	case 0x1A:
-	case 0x2A:
-	case 0x3A:
-	case 0x4A:
-	case 0x6A:
+	case AM_ACC:
 		sprintf(pbuf,"A");
-		offset=1;
 		break;
-		// Block Move
-	case 0x44:
-	case 0x54:
-		sprintf(pbuf,"$%02X,$%02X",mem[1],mem[2]);
-		offset=3;
+	case AM_MOVE:
+		// Assembler source takes the banks in source,destination order
+		if (tsrc & 4)
+		{
+			sprintf(pbuf,"$%02X,$%02X",mem[2],mem[1]);
+		}
+		else
+		{
+			sprintf(pbuf,"$%02X,$%02X",mem[1],mem[2]);
+		}
+		break;
+	case AM_SIG:
+		sprintf(pbuf,(tsrc & 4) ? "#$%02X" : "$%02X",mem[1]);
 		break;
-		// Direct Page
-	case 0x04:
-	case 0x05:
-	case 0x06:
-	case 0x14:
-	case 0x24:
-	case 0x25:
-	case 0x26:
-	case 0x45:
-	case 0x46:
-	case 0x64:
-	case 0x65:
-	case 0x66:
-	case 0x84:
-	case 0x85:
-	case 0x86:
-	case 0xA4:
-	case 0xA5:
-	case 0xA6:
-	case 0xC4:
-	case 0xC5:
-	case 0xC6:
-	case 0xE4:
-	case 0xE5:
-	case 0xE6:
+	case AM_DP:
 		sprintf(pbuf,"$%02X",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indexed, X
-	case 0x15:
-	case 0x16:
-	case 0x34:
-	case 0x35:
-	case 0x36:
-	case 0x55:
-	case 0x56:
-	case 0x74:
-	case 0x75:
-	case 0x76:
-	case 0x94:
-	case 0x95:
-	case 0xB4:
-	case 0xB5:
-	case 0xD5:
-	case 0xD6:
-	case 0xF5:
-	case 0xF6:
+	case AM_DPX:
 		sprintf(pbuf,"$%02X,X",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indexed, Y
-	case 0x96:
-	case 0xB6:
+	case AM_DPY:
 		sprintf(pbuf,"$%02X,Y",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indirect
-	case 0x12:
-	case 0x32:
-	case 0x52:
-	case 0x72:
-	case 0x92:
-	case 0xB2:
-	case 0xD2:
-	case 0xF2:
+	case AM_DPIND:
 		sprintf(pbuf,"($%02X)",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indirect Long
-	case 0x07:
-	case 0x27:
-	case 0x47:
-	case 0x67:
-	case 0x87:
-	case 0xA7:
-	case 0xC7:
-	case 0xE7:
+	case AM_DPINDL:
 		sprintf(pbuf,"[$%02X]",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indexed Indirect, X
-	case 0x01:
-	case 0x21:
-	case 0x41:
-	case 0x61:
-	case 0x81:
-	case 0xA1:
-	case 0xC1:
-	case 0xE1:
+	case AM_DPINDX:
 		sprintf(pbuf,"($%02X,X)",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indirect Indexed, Y
-	case 0x11:
-	case 0x31:
-	case 0x51:
-	case 0x71:
-	case 0x91:
-	case 0xB1:
-	case 0xD1:
-	case 0xF1:
+	case AM_DPINDY:
 		sprintf(pbuf,"($%02X),Y",mem[1]);
-		offset=2;
 		break;
-		// Direct Page Indirect Long Indexed, Y
-	case 0x17:
-	case 0x37:
-	case 0x57:
-	case 0x77:
-	case 0x97:
-	case 0xB7:
-	case 0xD7:
-	case 0xF7:
+	case AM_DPINDLY:
 		sprintf(pbuf,"[$%02X],Y",mem[1]);
-		offset=2;
 		break;
-		// Stack (Pull)
-	case 0x28:
-	case 0x2B:
-	case 0x68:
-	case 0x7A:
-	case 0xAB:
-	case 0xFA:
-		// Stack (Push)
-	case 0x08:
-	case 0x0B:
-	case 0x48:
-	case 0x4B:
-	case 0x5A:
-	case 0x8B:
-	case 0xDA:
-		// Stack (RTL)
-	case 0x6B:
-		// Stack (RTS)
-	case 0x60:
-		// Stack/RTI
-	case 0x40:
-		// Implied
-	case 0x18:
-	case 0x1B:
-	case 0x38:
-	case 0x3B:
-	case 0x58:
-	case 0x5B:
-	case 0x78:
-	case 0x7B:
-	case 0x88:
-	case 0x8A:
-	case 0x98:
-	case 0x9A:
-	case 0x9B:
-	case 0xA8:
-	case 0xAA:
-	case 0xB8:
-	case 0xBA:
-	case 0xBB:
-	case 0xC8:
-	case 0xCA:
-	case 0xCB:
-	case 0xD8:
-	case 0xDB:
-	case 0xE8:
-	case 0xEA:
-	case 0xEB:
-	case 0xF8:
-	case 0xFB:
+	case AM_IMP:
 		pbuf[0] = 0;
-		offset = 1;
 		break;
-		// Program Counter Relative
-	case 0x10:
-	case 0x30:
-	case 0x50:
-	case 0x70:
-	case 0x80:
-	case 0x90:
-	case 0xB0:
-	case 0xD0:
-	case 0xF0:
+	case AM_REL:
 		// Calculate the signed value of the param
 		sval = (mem[1]>127) ? (mem[1]-256) : mem[1];
-		sprintf(pbuf, "$%04lX", (pos+sval+2) & 0xFFFF);
-		offset = 2;
+		target = (pos+sval+2) & 0xFFFF;
+		// Assembler source needs the full address to work the offset out from
+		if (tsrc & 4)
+		{
+			target |= pos & 0xFF0000;
+		}
+		sprintf(pbuf, (tsrc & 4) ? "$%06lX" : "$%04lX", target);
 		break;
-		// Stack (Program Counter Relative Long)
-	case 0x62:
-		// Program Counter Relative Long
-	case 0x82:
+	case AM_RELL:
 		// Calculate the signed value of the param
 		sval = mem[1] + mem[2]*256;
 		sval = (sval>32767) ? (sval-65536) : sval;
-		sprintf(pbuf, "$%04lX", (pos+sval+3) & 0xFFFF);
-		offset = 3;
+		target = (pos+sval+3) & 0xFFFF;
+		if (tsrc & 4)
+		{
+			target |= pos & 0xFF0000;
+		}
+		sprintf(pbuf, (tsrc & 4) ? "$%06lX" : "$%04lX", target);
 		break;
-		// Stack Relative Indirect Indexed, Y
-	case 0x13:
-	case 0x33:
-	case 0x53:
-	case 0x73:
-	case 0x93:
-	case 0xB3:
-	case 0xD3:
-	case 0xF3:
+	case AM_SRINDY:
 		sprintf(pbuf, "($%02X,S),Y", mem[1]);
-		offset = 2;
-		break;
-		// Stack (Absolute)
-	case 0xF4:
-		sprintf(pbuf, "$%04X", mem[1] + mem[2]*256);
-		offset = 3;
-		break;
-		// Stack (Direct Page Indirect)
-	case 0xD4:
-		sprintf(pbuf,"($%02X)",mem[1]);
-		offset = 2;
-		break;
-		offset = 3;
 		break;
-		// Stack Relative
-	case 0x03:
-	case 0x23:
-	case 0x43:
-	case 0x63:
-	case 0x83:
-	case 0xA3:
-	case 0xC3:
-	case 0xE3:
+	case AM_SR:
 		sprintf(pbuf,"$%02X,S",mem[1]);
-		offset = 2;
 		break;
-		// WDM mode
-	case 0x42:
-		// Stack/Interrupt
-	case 0x00:
-	case 0x02:
-		sprintf(pbuf,"$%02X",mem[1]);
-		offset = 2;
-		break;
-		// Immediate (Invariant)
-	case 0xC2:
-		// REP following
-		*flag=*flag&~mem[1];
+	case AM_IMM8:
 		sprintf(pbuf,"#$%02X",mem[1]);
-		offset = 2;
 		break;
-	case 0xE2:
-		// SEP following
-		*flag = *flag|mem[1];
-		sprintf(pbuf, "#$%02X", mem[1]);
-		offset = 2;
-		break;
-		// Immediate (A size dependent)
-	case 0x09:
-	case 0x29:
-	case 0x49:
-	case 0x69:
-	case 0x89:
-	case 0xA9:
-	case 0xC9:
-	case 0xE9:
-		if (*flag & 0x20)
-		{
-			sprintf(pbuf, "#$%02X", mem[1]);
-			offset = 2;
-		}
-		else
-		{
-			sprintf(pbuf,"#$%04X",mem[1]+mem[2]*256);
-			offset = 3;
-		}
-		break;
-		// Immediate (X/Y size dependent)
-	case 0xA0:
-	case 0xA2:
-	case 0xC0:
-	case 0xE0:
-		if ((*flag) & 0x10)
-		{
-			sprintf(pbuf,"#$%02X",mem[1]);
-			offset = 2;
-		}
-		else
-		{
-			sprintf(pbuf,"#$%04X",mem[1]+mem[2]*256);
-			offset = 3;
-		}
+	case AM_IMMM:
+	case AM_IMMX:
+		sprintf(pbuf, (offset == 2) ? "#$%02X" : "#$%04X", mem[1] + (offset == 3 ? mem[2]*256 : 0));
 		break;
 	default:
-		printf("Unhandled Addressing Mode: %02X\n",mem[0]);
-		exit(1);
+		// Every opcode has a mode; just in case, no operand
+		pbuf[0] = 0;
 	};
 
+	// Assembler source spells out the operand size wherever an assembler
+	// could pick another one for the same operand
+	if (tsrc & 4)
+	{
+		switch (opmode[mem[0]])
+		{
+		case AM_DP:
+		case AM_DPX:
+		case AM_DPY:
+			strcat(ibuf, ".b");
+			break;
+		case AM_ABS:
+		case AM_ABSX:
+		case AM_ABSY:
+			strcat(ibuf, ".w");
+			break;
+		case AM_LONG:
+		case AM_LONGX:
+			if (mem[0] != 0x22 && mem[0] != 0x5C)
+			{
+				strcat(ibuf, ".l");
+			}
+			break;
+		case AM_IMMM:
+		case AM_IMMX:
+			strcat(ibuf, (offset == 2) ? ".b" : ".w");
+			break;
+		}
+	}
+
+	// Follow REP/SEP and mode switches
+	stepflag(mem, offset, flag);
+
 	// Generate hex output
 	for (i=0; i<offset; i++)
 	{
@@ -1002,6 +403,10 @@ int disasm(unsigned char *mem, unsigned long pos, unsigned char *flag, char *ins
 	{
 		sprintf(inst, "%02lX/%04lX:\t%s\t%s %s", (pos >> 16) & 0xFF, pos&0xFFFF, hbuf, ibuf, pbuf);
 	}
+	else if ((tsrc & 4) && pbuf[0] == 0)
+	{
+		strcpy(inst, ibuf);
+	}
 	else
 	{
 		sprintf(inst, "%s %s", ibuf, pbuf);
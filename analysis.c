@@ -0,0 +1,827 @@
+/* analysis.c
+ * Code discovery module for DisPel
+ * Traces reachable code from the vectors (and any user entry point),
+ * following branches, calls and jump tables, and records the result
+ * in a code map with one byte per file offset. The direct page and data
+ * bank registers are tracked along the way to resolve operand addresses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Maximum number of entries accepted from a single jump table
+#define MAXTABLE 256
+// Number of recent instructions remembered for the indirect jump heuristic
+#define HISTORY 4
+// Number of stack bytes tracked for PHK/PLB style idioms
+#define STACKDEPTH 8
+
+// Register state along one path of the trace
+struct tstate
+{
+	unsigned long addr;
+	unsigned short flag;
+	int al,ah;					// accumulator bytes, -1 if unknown
+	long d;						// direct page, -1 if unknown
+	int dbr;					// data bank, -1 if unknown
+	int sp;						// number of tracked stack bytes
+	int stack[STACKDEPTH];		// tracked stack bytes, -1 if unknown
+};
+
+static struct tstate *queue;
+static int qlen, qsize;
+
+static void push(struct tstate *st, unsigned long addr)
+{
+	if (qlen == qsize)
+	{
+		qsize = qsize ? qsize * 2 : 256;
+		queue = realloc(queue, qsize * sizeof(struct tstate));
+		if (queue == NULL)
+		{
+			printf("Cant alloc trace queue.\n");
+			exit(1);
+		}
+	}
+	queue[qlen] = *st;
+	queue[qlen].addr = addr & 0xFFFFFF;
+	qlen++;
+}
+
+static void spush(struct tstate *st, int v)
+{
+	if (st->sp == STACKDEPTH)
+	{
+		memmove(st->stack, st->stack+1, (STACKDEPTH-1) * sizeof(int));
+		st->sp--;
+	}
+	st->stack[st->sp++] = v;
+}
+
+static int spull(struct tstate *st)
+{
+	return (st->sp > 0) ? st->stack[--st->sp] : -1;
+}
+
+/* call() - queues a subroutine with the return address on its stack */
+
+static void call(struct tstate *st, unsigned long addr, int retlen)
+{
+	struct tstate callee = *st;
+
+	while (retlen--)
+	{
+		spush(&callee, -1);
+	}
+	push(&callee, addr);
+}
+
+/* writesa() - does an instruction write the accumulator?
+ * Post: returns 1 for the ALU/load/transfer/pull instructions that
+ *       leave A (or the low byte of it) with a value the trace can't know.
+ */
+
+static int writesa(unsigned char op)
+{
+	// ORA, AND, EOR, ADC, LDA and SBC in all their memory/immediate forms
+	switch (opmode[op])
+	{
+	case AM_IMP:
+	case AM_ACC:
+	case AM_IMM8:
+	case AM_SIG:
+	case AM_STKABS:
+	case AM_REL:
+	case AM_RELL:
+	case AM_MOVE:
+		break;
+	default:
+		if ((op & 0x01) || (op & 0x1F) == 0x12)
+		{
+			return (op >> 5) != 4 && (op >> 5) != 6;
+		}
+	}
+
+	switch (op)
+	{
+		// ASL/ROL/LSR/ROR/INC/DEC A, PLA, TDC, TSC, TXA, TYA, MVN/MVP
+	case 0x0A:
+	case 0x1A:
+	case 0x2A:
+	case 0x3A:
+	case 0x4A:
+	case 0x6A:
+	case 0x68:
+	case 0x7B:
+	case 0x3B:
+	case 0x8A:
+	case 0x98:
+	case 0x44:
+	case 0x54:
+		return 1;
+	}
+	return 0;
+}
+
+/* effaddr() - resolves the address a memory operand refers to
+ * Pre:  mem - pointer to the instruction
+ *       ctx - D/DBR context of the instruction, see CTX_*
+ * Post: returns the 24-bit address of the operand (for indexed modes,
+ *       the base; for indirect modes, the pointer), or -1 if the operand
+ *       isn't a data address or the register it needs isn't known.
+ */
+
+long effaddr(unsigned char *mem, unsigned long ctx)
+{
+	switch (opmode[mem[0]])
+	{
+	case AM_ABS:
+		// JMP/JSR abs are code addresses in the program bank
+		if (mem[0] == 0x20 || mem[0] == 0x4C)
+		{
+			return -1;
+		}
+		// fall through
+	case AM_ABSX:
+	case AM_ABSY:
+		if (!(ctx & CTX_DBR))
+		{
+			return -1;
+		}
+		return (ctx & 0xFF0000) | mem[1] | (mem[2] << 8);
+	case AM_DP:
+	case AM_DPX:
+	case AM_DPY:
+	case AM_DPIND:
+	case AM_DPINDL:
+	case AM_DPINDX:
+	case AM_DPINDY:
+	case AM_DPINDLY:
+		if (!(ctx & CTX_D))
+		{
+			return -1;
+		}
+		return ((ctx & 0xFFFF) + mem[1]) & 0xFFFF;
+	}
+	return -1;
+}
+
+/* foldaddr() - folds the system bank mirrors onto the real address
+ * Post: returns addr, with the WRAM and register mirrors in the system
+ *       banks folded onto $7E0000-$7E1FFF and $002000-$007FFF.
+ */
+
+unsigned long foldaddr(unsigned long addr)
+{
+	addr &= 0xFFFFFF;
+	if (!(addr & 0x408000))
+	{
+		addr = (addr & 0xE000) ? (addr & 0xFFFF) : (0x7E0000 | (addr & 0x1FFF));
+	}
+	return addr;
+}
+
+/* markaccess() - sets an address in one of the per-bank access bitmaps
+ * Pre:  kind - ACC_READ, ACC_WRITE or ACC_EXEC
+ * Post: the bank's bitmap is allocated from the arena on first use. Data accesses are
+ *       folded as by foldaddr().
+ */
+
+void markaccess(struct analysis *an, unsigned long addr, int kind)
+{
+	unsigned char **bm;
+
+	addr = (kind != ACC_EXEC) ? foldaddr(addr) : (addr & 0xFFFFFF);
+
+	bm = &an->access[kind][addr >> 16];
+	if (*bm == NULL)
+	{
+		*bm = aalloc(&an->arena, 0x2000);
+	}
+	(*bm)[(addr & 0xFFFF) >> 3] |= 1 << (addr & 7);
+}
+
+int accessed(struct analysis *an, unsigned long addr, int kind)
+{
+	unsigned char *bm = an->access[kind][(addr >> 16) & 0xFF];
+
+	return bm != NULL && (bm[(addr & 0xFFFF) >> 3] & (1 << (addr & 7)));
+}
+
+/* markops() - records what one instruction executes, reads and writes
+ * Pre:  mem    - pointer to the instruction
+ *       pc     - its address
+ *       flag   - processor state it runs with
+ *       ctx    - its D/DBR context
+ *       offset - its length
+ * Post: the instruction bytes are marked executed, and its operand read
+ *       and/or written at the operand width, if the address is known.
+ *       Indirect modes only mark the pointer as read.
+ */
+
+static void markops(struct analysis *an, unsigned char *mem, unsigned long pc, unsigned short flag,
+	unsigned long ctx, int offset)
+{
+	unsigned char op = mem[0];
+	long ea;
+	int i,kinds,width;
+
+	for (i=0; i<offset; i++)
+	{
+		markaccess(an, (pc & 0xFF0000) | ((pc + i) & 0xFFFF), ACC_EXEC);
+	}
+
+	// X/Y register instructions go by the X flag, the rest by M
+	switch (op)
+	{
+	case 0xAE: case 0xA6: case 0xBE: case 0xB6:	// LDX
+	case 0xAC: case 0xA4: case 0xBC: case 0xB4:	// LDY
+	case 0x8E: case 0x86: case 0x96:			// STX
+	case 0x8C: case 0x84: case 0x94:			// STY
+	case 0xEC: case 0xE4: case 0xCC: case 0xC4:	// CPX, CPY
+		width = (flag & 0x10) ? 1 : 2;
+		break;
+	default:
+		width = (flag & 0x20) ? 1 : 2;
+	}
+
+	// Stores write, read-modify-writes do both, everything else reads
+	switch (op)
+	{
+	case 0x8D: case 0x8F: case 0x85: case 0x92: case 0x87: case 0x9D: case 0x9F:
+	case 0x99: case 0x95: case 0x81: case 0x91: case 0x97: case 0x83: case 0x93:	// STA
+	case 0x8E: case 0x86: case 0x96: case 0x8C: case 0x84: case 0x94:				// STX, STY
+	case 0x9C: case 0x64: case 0x9E: case 0x74:										// STZ
+		kinds = 1 << ACC_WRITE;
+		break;
+	case 0x0E: case 0x06: case 0x1E: case 0x16:	// ASL
+	case 0x4E: case 0x46: case 0x5E: case 0x56:	// LSR
+	case 0x2E: case 0x26: case 0x3E: case 0x36:	// ROL
+	case 0x6E: case 0x66: case 0x7E: case 0x76:	// ROR
+	case 0xEE: case 0xE6: case 0xFE: case 0xF6:	// INC
+	case 0xCE: case 0xC6: case 0xDE: case 0xD6:	// DEC
+	case 0x0C: case 0x04: case 0x1C: case 0x14:	// TSB, TRB
+		kinds = (1 << ACC_READ) | (1 << ACC_WRITE);
+		break;
+	default:
+		kinds = 1 << ACC_READ;
+	}
+
+	switch (opmode[op])
+	{
+	case AM_LONG:
+	case AM_LONGX:
+		// JML/JSL targets are code, not data
+		if (op == 0x5C || op == 0x22)
+		{
+			return;
+		}
+		ea = mem[1] | (mem[2] << 8) | (mem[3] << 16);
+		break;
+	case AM_DPIND:
+	case AM_DPINDX:
+	case AM_DPINDY:
+		ea = effaddr(mem, ctx);
+		kinds = 1 << ACC_READ;
+		width = 2;
+		break;
+	case AM_DPINDL:
+	case AM_DPINDLY:
+		ea = effaddr(mem, ctx);
+		kinds = 1 << ACC_READ;
+		width = 3;
+		break;
+	case AM_ABSIND:
+		ea = mem[1] | (mem[2] << 8);
+		kinds = 1 << ACC_READ;
+		width = 2;
+		break;
+	case AM_ABSINDL:
+		ea = mem[1] | (mem[2] << 8);
+		kinds = 1 << ACC_READ;
+		width = 3;
+		break;
+	case AM_ABSINDX:
+		ea = (pc & 0xFF0000) | mem[1] | (mem[2] << 8);
+		kinds = 1 << ACC_READ;
+		width = 2;
+		break;
+	default:
+		ea = effaddr(mem, ctx);
+	}
+	if (ea < 0)
+	{
+		return;
+	}
+
+	for (i=0; i<ACC_KINDS; i++)
+	{
+		if (kinds & (1 << i))
+		{
+			markaccess(an, ea, i);
+			if (width > 1)
+			{
+				markaccess(an, (ea & 0xFF0000) | ((ea + 1) & 0xFFFF), i);
+			}
+			if (width > 2)
+			{
+				markaccess(an, (ea & 0xFF0000) | ((ea + 2) & 0xFFFF), i);
+			}
+		}
+	}
+}
+
+/* savemap() - writes the access bitmaps to a file
+ * Pre:  file - name of the file to write
+ * Post: returns 0, or -1 if it couldn't be written. The file is a 16 byte
+ *       header ("DSPLMAP1", plane count and plane size as little-endian
+ *       32-bit words) followed by the read, write and exec planes, each
+ *       with one bit per 24-bit address: byte addr>>3, bit addr&7. Every
+ *       lookup is at a fixed offset, so the file can be mmapped as is.
+ */
+
+int savemap(struct analysis *an, const char *file)
+{
+	static unsigned char zero[0x2000];
+	unsigned char head[16] = { 'D','S','P','L','M','A','P','1' };
+	FILE *f;
+	int kind,bank;
+
+	head[8] = ACC_KINDS;
+	head[14] = 0x20;	// $200000 bytes per plane
+
+	if ((f = fopen(file, "wb")) == NULL)
+	{
+		return -1;
+	}
+	fwrite(head, sizeof(head), 1, f);
+	for (kind=0; kind<ACC_KINDS; kind++)
+	{
+		for (bank=0; bank<256; bank++)
+		{
+			fwrite(an->access[kind][bank] ? an->access[kind][bank] : zero, 0x2000, 1, f);
+		}
+	}
+	return (fclose(f) == 0) ? 0 : -1;
+}
+
+/* track() - follows the A/D/DBR/stack idioms through one instruction
+ * Pre:  st  - register state before the instruction
+ *       mem - pointer to the instruction
+ *       pc  - its address
+ * Post: st  - register state after it. Anything not understood becomes
+ *       unknown rather than guessed.
+ */
+
+static void track(struct tstate *st, unsigned char *mem, unsigned long pc)
+{
+	int m16 = !(st->flag & 0x20), x16 = !(st->flag & 0x10), lo, hi;
+
+	switch (mem[0])
+	{
+		// PHK
+	case 0x4B:
+		spush(st, (pc >> 16) & 0xFF);
+		return;
+		// PHB
+	case 0x8B:
+		spush(st, st->dbr);
+		return;
+		// PHD
+	case 0x0B:
+		spush(st, st->d < 0 ? -1 : (int)(st->d >> 8));
+		spush(st, st->d < 0 ? -1 : (int)(st->d & 0xFF));
+		return;
+		// PEA
+	case 0xF4:
+		spush(st, mem[2]);
+		spush(st, mem[1]);
+		return;
+		// PEI, PER
+	case 0xD4:
+	case 0x62:
+		spush(st, -1);
+		spush(st, -1);
+		return;
+		// PHA
+	case 0x48:
+		if (m16)
+		{
+			spush(st, st->ah);
+		}
+		spush(st, st->al);
+		return;
+		// PHX, PHY
+	case 0xDA:
+	case 0x5A:
+		if (x16)
+		{
+			spush(st, -1);
+		}
+		spush(st, -1);
+		return;
+		// PHP
+	case 0x08:
+		spush(st, -1);
+		return;
+		// PLB
+	case 0xAB:
+		st->dbr = spull(st);
+		return;
+		// PLD
+	case 0x2B:
+		lo = spull(st);
+		hi = spull(st);
+		st->d = (lo < 0 || hi < 0) ? -1 : (hi << 8) | lo;
+		return;
+		// PLA
+	case 0x68:
+		st->al = spull(st);
+		if (m16)
+		{
+			st->ah = spull(st);
+		}
+		return;
+		// PLX, PLY
+	case 0xFA:
+	case 0x7A:
+		if (x16)
+		{
+			spull(st);
+		}
+		spull(st);
+		return;
+		// PLP
+	case 0x28:
+		spull(st);
+		return;
+		// TCS, TXS lose track of the stack
+	case 0x1B:
+	case 0x9A:
+		st->sp = 0;
+		return;
+		// TCD
+	case 0x5B:
+		st->d = (st->al < 0 || st->ah < 0) ? -1 : (st->ah << 8) | st->al;
+		return;
+		// TDC
+	case 0x7B:
+		st->al = st->d < 0 ? -1 : (int)(st->d & 0xFF);
+		st->ah = st->d < 0 ? -1 : (int)(st->d >> 8);
+		return;
+		// XBA
+	case 0xEB:
+		lo = st->al;
+		st->al = st->ah;
+		st->ah = lo;
+		return;
+		// LDA #
+	case 0xA9:
+		st->al = mem[1];
+		if (m16)
+		{
+			st->ah = mem[2];
+		}
+		return;
+		// MVN/MVP leave DBR at the destination bank
+	case 0x44:
+	case 0x54:
+		st->dbr = mem[1];
+		st->al = st->ah = -1;
+		return;
+	}
+
+	if (writesa(mem[0]))
+	{
+		st->al = -1;
+		// 16-bit ops, and the transfers from 16-bit registers, change B too
+		if (m16 || mem[0] == 0x7B || mem[0] == 0x3B)
+		{
+			st->ah = -1;
+		}
+	}
+}
+
+/* jumptable() - queues the targets of a table of 16-bit code pointers
+ * Pre:  table - SNES address of the first table entry
+ *       bank  - bank the pointers refer to (the program bank)
+ * Post: valid entries are queued, marked in an->cmap and their targets
+ *       kept in an->ctx, stopping at the first entry that fails validation.
+ */
+
+static void jumptable(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	unsigned long table, unsigned long bank, struct tstate *st)
+{
+	unsigned char *cmap = an->cmap;
+	long toff,off;
+	unsigned long target;
+	int i;
+
+	toff = snes2off(map, table);
+	if (toff < 0)
+	{
+		return;
+	}
+
+	for (i=0; i<MAXTABLE; i++, toff+=2)
+	{
+		// The table mustn't leave the file, its bank, or run into known code
+		if ((unsigned long)toff + 2 > len || ((table + i*2) & 0xFFFF) > 0xFFFE)
+		{
+			break;
+		}
+		if (cmap[toff] & (CM_OP|CM_OPERAND|CM_TARGET) || cmap[toff+1] & (CM_OP|CM_OPERAND|CM_TARGET))
+		{
+			break;
+		}
+
+		// The entry must point at ROM, outside the table itself
+		target = bank | data[toff] | (data[toff+1] << 8);
+		off = snes2off(map, target);
+		if (off < 0 || (unsigned long)off >= len)
+		{
+			break;
+		}
+		if (off >= toff - i*2 && off < toff + 2)
+		{
+			break;
+		}
+		// ...and not into the middle of an instruction or at fill bytes
+		if ((cmap[off] & (CM_OPERAND|CM_PTR)) || data[off] == 0x00 || data[off] == 0xFF)
+		{
+			break;
+		}
+
+		cmap[toff] |= CM_PTR;
+		cmap[toff+1] |= CM_PTR;
+		an->ctx[toff] = target;
+		cmap[off] |= CM_TARGET;
+		push(st, target);
+	}
+}
+
+/* aninit() - sets up an empty analysis
+ * Pre:  len - image length
+ * Post: an has a cleared code map and context for len bytes, ready for
+ *       loadcdl() and trace(). Everything in it comes from its arena,
+ *       and anfree() releases the lot.
+ */
+
+void aninit(struct analysis *an, unsigned long len)
+{
+	memset(an, 0, sizeof(struct analysis));
+	an->cmap = aalloc(&an->arena, len);
+	an->ctx = aalloc(&an->arena, len * sizeof(unsigned long));
+}
+
+/* trace() - builds a code map by following control flow
+ * Pre:  an     - analysis from aninit(), possibly seeded by loadcdl()
+ *       data   - ROM image
+ *       len    - image length
+ *       map    - memory mapper for the image
+ *       entry  - entry points to start tracing from
+ *       nentry - number of entry points
+ * Post: an->cmap holds the code map (len bytes, see CM_*), an->ctx the
+ *       D/DBR context of each instruction and an->access the resolved
+ *       operand addresses. Code already in the map is left alone, so a
+ *       trace only fills in what a loaded log didn't cover.
+ */
+
+void trace(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct entry *entry, int nentry)
+{
+	unsigned char *cmap,mem[4],op;
+	const unsigned char *lens;
+	unsigned long pc,bank,operand;
+	unsigned long hist[HISTORY];
+	unsigned char hop[HISTORY];
+	struct tstate st;
+	long off;
+	int i,offset,stop;
+
+	cmap = an->cmap;
+	qlen = 0;
+	for (i=0; i<nentry; i++)
+	{
+		off = snes2off(map, entry[i].addr);
+		if (off >= 0 && (unsigned long)off < len)
+		{
+			cmap[off] |= CM_TARGET;
+			memset(&st, 0, sizeof(st));
+			st.flag = entry[i].flag;
+			st.al = st.ah = -1;
+			st.d = (entry[i].ctx & CTX_D) ? (long)(entry[i].ctx & 0xFFFF) : -1;
+			st.dbr = (entry[i].ctx & CTX_DBR) ? (int)((entry[i].ctx >> 16) & 0xFF) : -1;
+			push(&st, entry[i].addr);
+		}
+	}
+
+	while (qlen > 0)
+	{
+		qlen--;
+		st = queue[qlen];
+		pc = st.addr;
+		lens = oplen[OPSTATE(st.flag)];
+		memset(hop, 0xEA, HISTORY);
+		memset(hist, 0, sizeof(hist));
+
+		// Every path starts at a branch, call or jump target
+		off = snes2off(map, pc);
+		if (off >= 0 && (unsigned long)off < len && !(cmap[off] & CM_OPERAND))
+		{
+			cmap[off] |= CM_TARGET;
+		}
+
+		for (stop=0; !stop; )
+		{
+			off = snes2off(map, pc);
+			if (off < 0 || (unsigned long)off >= len)
+			{
+				break;
+			}
+			// Already traced, or would decode through an existing instruction
+			if ((cmap[off] & (CM_OPERAND|CM_PTR)) || (cmap[off] & (CM_OP|CM_LOGGED)) == CM_OP)
+			{
+				break;
+			}
+			// Logged code is traced through once, at the widths it really ran with
+			if (cmap[off] & CM_LOGGED)
+			{
+				st.flag = (st.flag & ~0x30) | (cmap[off] & 0x30);
+				lens = oplen[OPSTATE(st.flag)];
+				cmap[off] &= ~CM_LOGGED;
+			}
+
+			memset(mem, 0, 4);
+			memcpy(mem, data+off, (len-off) < 4 ? (len-off) : 4);
+			op = mem[0];
+
+			cmap[off] |= CM_OP | (st.flag & 0x30) | ((st.flag & FLAG_E) ? CM_EMU : 0);
+			offset = lens[op];
+
+			// Instructions never straddle a bank or the end of the image
+			if ((pc & 0xFFFF) + offset > 0x10000 || off + offset > len)
+			{
+				cmap[off] &= ~(CM_OP|CM_EMU|0x30);
+				break;
+			}
+			for (i=1; i<offset; i++)
+			{
+				cmap[off+i] |= CM_OPERAND;
+			}
+
+			bank = pc & 0xFF0000;
+			operand = mem[1] | (mem[2] << 8);
+
+			// Record the registers the operand depends on, and what it refers to
+			an->ctx[off] = (st.d < 0 ? 0 : CTX_D | st.d) | (st.dbr < 0 ? 0 : CTX_DBR | ((unsigned long)st.dbr << 16));
+			markops(an, mem, pc, st.flag, an->ctx[off], offset);
+			track(&st, mem, pc);
+
+			// REP/SEP and mode switches pick a new length table
+			if (stepflag(mem, offset, &st.flag))
+			{
+				lens = oplen[OPSTATE(st.flag)];
+			}
+
+			switch (op)
+			{
+				// Conditional branches
+			case 0x10:
+			case 0x30:
+			case 0x50:
+			case 0x70:
+			case 0x90:
+			case 0xB0:
+			case 0xD0:
+			case 0xF0:
+				push(&st, bank | ((pc + 2 + (signed char)mem[1]) & 0xFFFF));
+				break;
+				// BRA
+			case 0x80:
+				push(&st, bank | ((pc + 2 + (signed char)mem[1]) & 0xFFFF));
+				stop = 1;
+				break;
+				// BRL
+			case 0x82:
+				push(&st, bank | ((pc + 3 + (short)operand) & 0xFFFF));
+				stop = 1;
+				break;
+				// JSR abs
+			case 0x20:
+				call(&st, bank | operand, 2);
+				break;
+				// JMP abs
+			case 0x4C:
+				push(&st, bank | operand);
+				stop = 1;
+				break;
+				// JSL long
+			case 0x22:
+				call(&st, operand | (mem[3] << 16), 3);
+				break;
+				// JML long
+			case 0x5C:
+				push(&st, operand | (mem[3] << 16));
+				stop = 1;
+				break;
+				// JSR (abs,X)
+			case 0xFC:
+				jumptable(an, data, len, map, bank | operand, bank, &st);
+				break;
+				// JMP (abs,X)
+			case 0x7C:
+				jumptable(an, data, len, map, bank | operand, bank, &st);
+				stop = 1;
+				break;
+				// JMP (abs)
+			case 0x6C:
+				// The vector lives in bank 0; if that's ROM it can be read directly
+				off = snes2off(map, operand);
+				if (off >= 0 && (unsigned long)off + 2 <= len)
+				{
+					push(&st, bank | data[off] | (data[off+1] << 8));
+				}
+				// Otherwise look for the "lda table,x / sta vector" idiom
+				for (i=0; i<HISTORY-1; i++)
+				{
+					if (((hop[i] == 0x85 && (hist[i] & 0xFF) == (operand & 0xFF)) || (hop[i] == 0x8D && hist[i] == operand)) &&
+						(hop[i+1] == 0xBD || hop[i+1] == 0xB9 || hop[i+1] == 0xBF))
+					{
+						jumptable(an, data, len, map, hist[i+1], bank, &st);
+						break;
+					}
+				}
+				stop = 1;
+				break;
+				// JML [abs]
+			case 0xDC:
+				off = snes2off(map, operand);
+				if (off >= 0 && (unsigned long)off + 3 <= len)
+				{
+					push(&st, data[off] | (data[off+1] << 8) | (data[off+2] << 16));
+				}
+				stop = 1;
+				break;
+				// Returns, BRK and STP end the trace
+			case 0x00:
+			case 0x40:
+			case 0x60:
+			case 0x6B:
+			case 0xDB:
+				stop = 1;
+				break;
+			}
+
+			// Remember this instruction for the indirect jump heuristic
+			memmove(hist+1, hist, (HISTORY-1) * sizeof(hist[0]));
+			memmove(hop+1, hop, HISTORY-1);
+			hop[0] = op;
+			hist[0] = operand | (offset == 4 ? (mem[3] << 16) : 0);
+			// Tables read with lda abs,X/Y live in the data bank
+			if (op == 0xBD || op == 0xB9)
+			{
+				hist[0] |= (an->ctx[off] & CTX_DBR) ? (an->ctx[off] & 0xFF0000) : bank;
+			}
+
+			pc = bank | ((pc + offset) & 0xFFFF);
+		}
+	}
+
+	free(queue);
+	queue = NULL;
+	qsize = 0;
+}
+
+void anfree(struct analysis *an)
+{
+	afree(&an->arena);
+	memset(an, 0, sizeof(struct analysis));
+}
+
+/* datarun() - measures a run of untraced bytes
+ * Pre:  cmap - code map from trace()
+ *       pos  - "address" of the first byte
+ *       rpos - file offset of the first byte
+ *       len  - image length
+ *       end  - last file offset to output
+ * Post: returns the number of bytes up to the next instruction, jump
+ *       table boundary, the end of the bank or block, or 16, whichever
+ *       comes first.
+ */
+
+int datarun(unsigned char *cmap, unsigned long pos, unsigned long rpos, unsigned long len, unsigned long end)
+{
+	int n = 0;
+
+	do
+	{
+		n++;
+	} while (n < 16 && rpos+n < len && rpos+n <= end && ((pos+n) & 0xFFFF) != 0 &&
+		!(cmap[rpos+n] & CM_OP) && !((cmap[rpos+n] ^ cmap[rpos]) & CM_PTR));
+
+	return n;
+}
@@ -0,0 +1,114 @@
+/* arena.c
+ * Arena allocator for DisPel
+ * Everything one analysis needs - code map, contexts, access bitmaps -
+ * comes out of a few big blocks and goes back in one go, rather than
+ * one malloc() per bitmap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "dispel.h"
+
+// Smallest block taken from the system, and the alignment of allocations
+#define ABLOCK		0x100000
+#define AALIGN		16
+
+struct ablock
+{
+	struct ablock *next;		// older block
+	unsigned long size;			// bytes after the header
+	unsigned long used;
+};
+
+// Header size, rounded up so the first allocation is aligned
+#define AHEAD		((sizeof(struct ablock) + AALIGN - 1) & ~(unsigned long)(AALIGN - 1))
+
+/* aalloc() - allocates zeroed memory from an arena
+ * Pre:  a - arena, zeroed to start with
+ *       n - bytes wanted
+ * Post: returns the memory, which lasts until afree(). Requests bigger
+ *       than a block get a block of their own.
+ */
+
+void *aalloc(struct arena *a, unsigned long n)
+{
+	struct ablock *b = a->head;
+	unsigned long size;
+	clock_t t;
+
+	n = (n + AALIGN - 1) & ~(unsigned long)(AALIGN - 1);
+	if (b == NULL || b->size - b->used < n)
+	{
+		size = (n > ABLOCK) ? n : ABLOCK;
+		t = clock();
+		if ((b = calloc(1, AHEAD + size)) == NULL)
+		{
+			printf("Cant alloc %ld bytes.\n", size);
+			exit(1);
+		}
+		a->secs += (double)(clock() - t) / CLOCKS_PER_SEC;
+		b->size = size;
+
+		// A block of its own is used up at once; keep filling the current one
+		if (a->head != NULL && size - n < a->head->size - a->head->used)
+		{
+			b->next = a->head->next;
+			a->head->next = b;
+		}
+		else
+		{
+			b->next = a->head;
+			a->head = b;
+		}
+		a->size += size;
+		a->nblock++;
+	}
+
+	b->used += n;
+	a->used += n;
+	return (char *)b + AHEAD + b->used - n;
+}
+
+/* afree() - releases everything allocated from an arena
+ * Post: the arena is empty, with its counters cleared.
+ */
+
+void afree(struct arena *a)
+{
+	struct ablock *b,*next;
+
+	for (b=a->head; b!=NULL; b=next)
+	{
+		next = b->next;
+		free(b);
+	}
+	memset(a, 0, sizeof(struct arena));
+}
+
+/* peakrss() - the most memory the process has had resident
+ * Post: returns the peak resident set size in K, or -1 where it can't be
+ *       found out.
+ */
+
+long peakrss(void)
+{
+#ifndef _WIN32
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+	{
+#ifdef __APPLE__
+		return ru.ru_maxrss / 1024;
+#else
+		return ru.ru_maxrss;
+#endif
+	}
+#endif
+	return -1;
+}
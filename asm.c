@@ -0,0 +1,638 @@
+/* asm.c
+ * 65816 assembler module for DisPel
+ * Turns source back into bytes, using the same opcode tables as the
+ * disassembler: single lines, patch files, and an all-opcode test ROM.
+ * Understands the syntax DisPel writes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "dispel.h"
+
+// Operand syntax, before the size is taken into account
+#define OS_NONE		0	// nothing
+#define OS_ACC		1	// A
+#define OS_IMM		2	// #$xx
+#define OS_ADDR		3	// $xx
+#define OS_X		4	// $xx,X
+#define OS_Y		5	// $xx,Y
+#define OS_S		6	// $xx,S
+#define OS_IND		7	// ($xx)
+#define OS_INDX		8	// ($xx,X)
+#define OS_INDY		9	// ($xx),Y
+#define OS_SINDY	10	// ($xx,S),Y
+#define OS_INDL		11	// [$xx]
+#define OS_INDLY	12	// [$xx],Y
+#define OS_MOVE		13	// $xx,$xx
+
+// A parsed operand
+struct operand
+{
+	int syntax;				// OS_*
+	int size;				// size in bytes, from the hint or the digits
+	unsigned long value;
+	unsigned long value2;	// second bank of MVN/MVP
+};
+
+/* hexval() - reads a $ prefixed hex number
+ * Post: returns a pointer past it and sets *digits, or NULL if there
+ *       isn't one.
+ */
+
+static const char *hexval(const char *p, unsigned long *value, int *digits)
+{
+	if (*p++ != '$' || !isxdigit((unsigned char)*p))
+	{
+		return NULL;
+	}
+	for (*value=0, *digits=0; isxdigit((unsigned char)*p); p++, (*digits)++)
+	{
+		*value = (*value << 4) | (isdigit((unsigned char)*p) ? *p - '0' : (toupper((unsigned char)*p) - 'A' + 10));
+	}
+	return p;
+}
+
+/* match() - checks for some fixed text, ignoring case and spaces
+ * Post: returns a pointer past it, or NULL if it isn't there.
+ */
+
+static const char *match(const char *p, const char *text)
+{
+	for (; *text; text++)
+	{
+		while (*p == ' ' || *p == '\t')
+		{
+			p++;
+		}
+		if (toupper((unsigned char)*p) != toupper((unsigned char)*text))
+		{
+			return NULL;
+		}
+		p++;
+	}
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+	return p;
+}
+
+/* parseop() - works out the syntax and size of an operand
+ * Pre:  p    - operand text, without leading spaces
+ *       hint - size from a .b/.w/.l suffix, or 0
+ * Post: returns 0 and fills in o, or -1 if it can't be understood.
+ */
+
+static int parseop(const char *p, int hint, struct operand *o)
+{
+	static const struct { const char *pre, *post; int syntax; } forms[] =
+	{
+		{ "(", ",S),Y", OS_SINDY },
+		{ "(", ",X)", OS_INDX },
+		{ "(", "),Y", OS_INDY },
+		{ "(", ")", OS_IND },
+		{ "[", "],Y", OS_INDLY },
+		{ "[", "]", OS_INDL },
+		{ "#", "", OS_IMM },
+		{ "", ",X", OS_X },
+		{ "", ",Y", OS_Y },
+		{ "", ",S", OS_S },
+		{ "", "", OS_ADDR }
+	};
+	const char *q,*r;
+	int i,digits;
+
+	if (*p == 0)
+	{
+		o->syntax = OS_NONE;
+		return 0;
+	}
+	if ((q = match(p, "A")) != NULL && *q == 0)
+	{
+		o->syntax = OS_ACC;
+		return 0;
+	}
+
+	for (i=0; i<(int)(sizeof(forms)/sizeof(forms[0])); i++)
+	{
+		if ((q = match(p, forms[i].pre)) == NULL || (q = hexval(q, &o->value, &digits)) == NULL)
+		{
+			continue;
+		}
+		// MVN/MVP have two banks
+		if (forms[i].syntax == OS_ADDR && (r = match(q, ",")) != NULL && hexval(r, &o->value2, &digits) != NULL)
+		{
+			o->syntax = OS_MOVE;
+			return 0;
+		}
+		if ((q = match(q, forms[i].post)) == NULL || *q != 0)
+		{
+			continue;
+		}
+		o->syntax = forms[i].syntax;
+		o->size = hint ? hint : (digits <= 2) ? 1 : (digits <= 4) ? 2 : 3;
+		return 0;
+	}
+	return -1;
+}
+
+/* fits() - does an addressing mode take an operand?
+ * Post: returns the number of operand bytes the instruction would have,
+ *       or -1 if the mode and operand don't go together.
+ */
+
+static int fits(int mode, struct operand *o)
+{
+	static const struct { int mode, syntax, size; } modes[] =
+	{
+		{ AM_IMP, OS_NONE, 0 }, { AM_ACC, OS_ACC, 0 }, { AM_ACC, OS_NONE, 0 },
+		{ AM_IMM8, OS_IMM, 1 }, { AM_SIG, OS_IMM, 1 }, { AM_SIG, OS_ADDR, 1 },
+		{ AM_DP, OS_ADDR, 1 }, { AM_DPX, OS_X, 1 }, { AM_DPY, OS_Y, 1 },
+		{ AM_DPIND, OS_IND, 1 }, { AM_DPINDL, OS_INDL, 1 }, { AM_DPINDX, OS_INDX, 1 },
+		{ AM_DPINDY, OS_INDY, 1 }, { AM_DPINDLY, OS_INDLY, 1 },
+		{ AM_SR, OS_S, 1 }, { AM_SRINDY, OS_SINDY, 1 },
+		{ AM_ABS, OS_ADDR, 2 }, { AM_ABSX, OS_X, 2 }, { AM_ABSY, OS_Y, 2 },
+		{ AM_ABSIND, OS_IND, 2 }, { AM_ABSINDX, OS_INDX, 2 }, { AM_ABSINDL, OS_INDL, 2 },
+		{ AM_LONG, OS_ADDR, 3 }, { AM_LONGX, OS_X, 3 }, { AM_STKABS, OS_ADDR, 2 }
+	};
+	int i;
+
+	switch (mode)
+	{
+	case AM_IMMM:
+	case AM_IMMX:
+		return (o->syntax == OS_IMM && o->size <= 2) ? o->size : -1;
+	case AM_REL:
+		return (o->syntax == OS_ADDR) ? 1 : -1;
+	case AM_RELL:
+		return (o->syntax == OS_ADDR) ? 2 : -1;
+	case AM_MOVE:
+		return (o->syntax == OS_MOVE) ? 2 : -1;
+	}
+
+	for (i=0; i<(int)(sizeof(modes)/sizeof(modes[0])); i++)
+	{
+		if (modes[i].mode == mode && modes[i].syntax == o->syntax && (modes[i].size == 0 || modes[i].size == o->size))
+		{
+			return modes[i].size;
+		}
+	}
+	return -1;
+}
+
+/* directive() - assembles a db/dw/dl line
+ * Post: returns the number of bytes, or -1 if the values can't be read.
+ */
+
+static int directive(const char *p, int width, unsigned char *out)
+{
+	unsigned long value;
+	int n=0,i,digits;
+
+	do
+	{
+		while (*p == ' ' || *p == '\t')
+		{
+			p++;
+		}
+		if (*p == '"')
+		{
+			for (p++; *p && *p != '"' && n < ASMMAX; p++)
+			{
+				out[n++] = *p;
+			}
+			if (*p++ != '"')
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			if ((p = hexval(p, &value, &digits)) == NULL || n + width > ASMMAX)
+			{
+				return -1;
+			}
+			for (i=0; i<width; i++)
+			{
+				out[n++] = value >> (i*8);
+			}
+		}
+	} while ((p = match(p, ",")) != NULL);
+
+	return n;
+}
+
+/* assemble() - assembles one line of source
+ * Pre:  line - an instruction, a db/dw/dl directive, a label, or any of
+ *              those with a comment
+ *       pc   - address the line assembles at
+ *       out  - buffer for at least ASMMAX bytes
+ * Post: returns the number of bytes, 0 for lines with nothing to assemble
+ *       (labels, comments, org/base/mapper directives), or -1 if the
+ *       line isn't understood.
+ */
+
+int assemble(const char *line, unsigned long pc, unsigned char *out)
+{
+	char text[256],mnem[8],*p,*q;
+	struct operand o;
+	long rel;
+	int op,hint,size,i,inquote;
+
+	// Drop the comment and surrounding space
+	for (i=0, inquote=0; line[i] && i < (int)sizeof(text)-1; i++)
+	{
+		if (line[i] == '"')
+		{
+			inquote = !inquote;
+		}
+		if (line[i] == ';' && !inquote)
+		{
+			break;
+		}
+		text[i] = line[i];
+	}
+	text[i] = 0;
+	for (p=text; *p == ' ' || *p == '\t' || *p == '\n'; p++);
+	for (q=p+strlen(p); q>p && isspace((unsigned char)q[-1]); *--q=0);
+
+	// A label, possibly followed by more
+	for (q=p; isalnum((unsigned char)*q) || *q == '_'; q++);
+	if (*q == ':')
+	{
+		for (p=q+1; *p == ' ' || *p == '\t'; p++);
+	}
+	if (*p == 0)
+	{
+		return 0;
+	}
+
+	// The mnemonic or directive, and its size hint
+	for (i=0; isalnum((unsigned char)*p) && i < (int)sizeof(mnem)-1; p++)
+	{
+		mnem[i++] = tolower((unsigned char)*p);
+	}
+	mnem[i] = 0;
+	hint = 0;
+	if (*p == '.')
+	{
+		switch (tolower((unsigned char)p[1]))
+		{
+		case 'b':
+			hint = 1;
+			break;
+		case 'w':
+			hint = 2;
+			break;
+		case 'l':
+			hint = 3;
+			break;
+		default:
+			return -1;
+		}
+		p += 2;
+	}
+	if (*p != 0 && *p != ' ' && *p != '\t')
+	{
+		return -1;
+	}
+	while (*p == ' ' || *p == '\t')
+	{
+		p++;
+	}
+
+	if (strcmp(mnem, "db") == 0 || strcmp(mnem, "dw") == 0 || strcmp(mnem, "dl") == 0)
+	{
+		return directive(p, (mnem[1] == 'b') ? 1 : (mnem[1] == 'w') ? 2 : 3, out);
+	}
+	if (strcmp(mnem, "org") == 0 || strcmp(mnem, "base") == 0 || mapdirective(mnem) >= 0)
+	{
+		return 0;
+	}
+
+	if (parseop(p, hint, &o) < 0)
+	{
+		return -1;
+	}
+
+	for (op=0; op<256; op++)
+	{
+		if ((strcmp(mnem, opname[op]) != 0 && strcmp(mnem, mnemonic(op, 4)) != 0) || (size = fits(opmode[op], &o)) < 0)
+		{
+			continue;
+		}
+
+		out[0] = op;
+		switch (opmode[op])
+		{
+		case AM_REL:
+		case AM_RELL:
+			// Targets without a bank are in the current one
+			if (o.value < 0x10000)
+			{
+				o.value |= pc & 0xFF0000;
+			}
+			if ((o.value & 0xFF0000) != (pc & 0xFF0000))
+			{
+				return -1;
+			}
+			// The PC wraps within the bank, so the displacement does too
+			rel = (long)((o.value - (pc + 1 + size)) & 0xFFFF);
+			rel -= (rel >= 0x8000) ? 0x10000 : 0;
+			if (opmode[op] == AM_REL)
+			{
+				if (rel < -128 || rel > 127)
+				{
+					return -1;
+				}
+			}
+			o.value = rel;
+			break;
+		case AM_MOVE:
+			// Source bank first, but the destination is encoded first
+			o.value = o.value2 | (o.value << 8);
+			break;
+		}
+		for (i=0; i<size; i++)
+		{
+			out[1+i] = o.value >> (i*8);
+		}
+		return 1 + size;
+	}
+	return -1;
+}
+
+/* asmfile() - assembles a source file into an image
+ * Pre:  file - source: "org $xxxxxx" lines to say where code goes (and
+ *              "base $xxxxxx" to assemble for another address), then
+ *              instructions and db/dw/dl lines, as assemble() takes them
+ *       data - image to patch, len bytes
+ *       map  - memory mapper for the image
+ * Post: returns the number of bytes written into the image, or -1 if a
+ *       line can't be assembled or would land outside the image.
+ */
+
+int asmfile(const char *file, unsigned char *data, unsigned long len, struct mapper *map)
+{
+	FILE *f;
+	char line[256],word[8];
+	unsigned char out[ASMMAX];
+	unsigned long pc=0,addr;
+	long off=-1;
+	int n,i,lineno=0,total=0;
+
+	if ((f = fopen(file, "r")) == NULL)
+	{
+		printf("Cannot open %s for reading.\n", file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		lineno++;
+
+		// org moves both the address and the place in the image, base
+		// just the address
+		if (sscanf(line, " %7s $%6lX", word, &addr) == 2 && (strcmp(word, "org") == 0 || strcmp(word, "base") == 0))
+		{
+			pc = addr;
+			if (word[0] == 'o' && (off = snes2off(map, addr)) < 0)
+			{
+				printf("%s(%d): $%06lX isn't in the image.\n", file, lineno, addr);
+				fclose(f);
+				return -1;
+			}
+			continue;
+		}
+
+		if ((n = assemble(line, pc, out)) < 0)
+		{
+			printf("%s(%d): can't assemble this line.\n", file, lineno);
+			fclose(f);
+			return -1;
+		}
+		if (n > 0 && (off < 0 || (unsigned long)off + n > len))
+		{
+			printf("%s(%d): no org, or past the end of the image.\n", file, lineno);
+			fclose(f);
+			return -1;
+		}
+
+		for (i=0; i<n; i++)
+		{
+			data[off+i] = out[i];
+		}
+		off += n;
+		pc = (pc & 0xFF0000) | ((pc + n) & 0xFFFF);
+		total += n;
+	}
+
+	fclose(f);
+	return total;
+}
+
+/* testline() - source for one opcode with a sample operand
+ * Pre:  op   - opcode
+ *       pc   - address it goes at
+ *       flag - processor state, for the immediate sizes
+ */
+
+static void testline(char *line, unsigned char op, unsigned long pc, unsigned short flag)
+{
+	char *p = line + sprintf(line, "%s ", mnemonic(op, 4));
+
+	switch (opmode[op])
+	{
+	case AM_ACC:
+		strcpy(p, "A");
+		break;
+	case AM_IMM8:
+		// REP/SEP #0 leave the state alone
+		strcpy(p, "#$00");
+		break;
+	case AM_IMMM:
+	case AM_IMMX:
+		strcpy(p, (oplen[OPSTATE(flag)][op] == 2) ? "#$12" : "#$1234");
+		break;
+	case AM_SIG:
+		strcpy(p, "#$12");
+		break;
+	case AM_DP:
+		strcpy(p, "$12");
+		break;
+	case AM_DPX:
+		strcpy(p, "$12,X");
+		break;
+	case AM_DPY:
+		strcpy(p, "$12,Y");
+		break;
+	case AM_DPIND:
+		strcpy(p, "($12)");
+		break;
+	case AM_DPINDL:
+		strcpy(p, "[$12]");
+		break;
+	case AM_DPINDX:
+		strcpy(p, "($12,X)");
+		break;
+	case AM_DPINDY:
+		strcpy(p, "($12),Y");
+		break;
+	case AM_DPINDLY:
+		strcpy(p, "[$12],Y");
+		break;
+	case AM_SR:
+		strcpy(p, "$12,S");
+		break;
+	case AM_SRINDY:
+		strcpy(p, "($12,S),Y");
+		break;
+	case AM_ABS:
+	case AM_STKABS:
+		strcpy(p, "$1234");
+		break;
+	case AM_ABSX:
+		strcpy(p, "$1234,X");
+		break;
+	case AM_ABSY:
+		strcpy(p, "$1234,Y");
+		break;
+	case AM_ABSIND:
+		strcpy(p, "($1234)");
+		break;
+	case AM_ABSINDX:
+		strcpy(p, "($1234,X)");
+		break;
+	case AM_ABSINDL:
+		strcpy(p, "[$1234]");
+		break;
+	case AM_LONG:
+		strcpy(p, "$123456");
+		break;
+	case AM_LONGX:
+		strcpy(p, "$123456,X");
+		break;
+	case AM_REL:
+	case AM_RELL:
+		// Branch to the next instruction
+		sprintf(p, "$%06lX", (pc & 0xFF0000) | ((pc + oplen[0][op]) & 0xFFFF));
+		break;
+	case AM_MOVE:
+		strcpy(p, "$12,$34");
+		break;
+	default:
+		p[-1] = 0;
+	}
+}
+
+/* testemit() - assembles one line of the test ROM
+ * Pre:  op  - opcode the line should give, or -1 if it doesn't matter
+ *       len - length it should have
+ * Post: returns 0 and advances pc, or -1 if the line didn't come out as
+ *       it should.
+ */
+
+static int testemit(unsigned char *rom, unsigned long *pc, const char *line, int op, int len)
+{
+	unsigned char out[ASMMAX];
+
+	if (assemble(line, *pc, out) != len || (op >= 0 && out[0] != op))
+	{
+		printf("Can't encode opcode %02X: %s\n", op, line);
+		return -1;
+	}
+	memcpy(rom + ((*pc & 0x7F0000) >> 1) + (*pc & 0x7FFF), out, len);
+	*pc += len;
+	return 0;
+}
+
+/* maketest() - writes a test ROM holding every opcode
+ * Pre:  file - name of the ROM to write
+ * Post: returns 0, or -1 if it couldn't be written or an opcode couldn't
+ *       be encoded. The ROM is a 128K LoROM image with every opcode, each
+ *       with a sample operand, twice from the reset vector: first with
+ *       16-bit registers, then (after SEP #$30) with 8-bit ones, and
+ *       two branches at the end of bank $81 that wrap around within it.
+ *       Every line goes through assemble().
+ */
+
+int maketest(const char *file)
+{
+	static const char title[] = "DISPEL OPCODE TEST   ";
+	unsigned char *rom;
+	unsigned long pc=0x808000,sum;
+	unsigned short flag;
+	char line[64];
+	FILE *f;
+	int pass,op,i,bad=0;
+
+	if ((rom = malloc(0x20000)) == NULL)
+	{
+		printf("Cant alloc test ROM.\n");
+		exit(1);
+	}
+	memset(rom, 0xFF, 0x20000);
+
+	for (pass=0; pass<2 && !bad; pass++)
+	{
+		flag = pass ? 0x30 : 0;
+		bad = testemit(rom, &pc, pass ? "sep #$30" : "rep #$30", -1, 2);
+		for (op=0; op<256 && !bad; op++)
+		{
+			// XCE swaps the carry in, which has to be clear to stay native
+			if (op == 0xFB)
+			{
+				bad = testemit(rom, &pc, "clc", -1, 1);
+			}
+			testline(line, op, pc, flag);
+			bad = bad || testemit(rom, &pc, line, op, oplen[OPSTATE(flag)][op]);
+		}
+	}
+	// ...and loop at the end
+	sprintf(line, "bra $%06lX", pc);
+	bad = bad || testemit(rom, &pc, line, 0x80, 2);
+
+	// Branches that wrap around within their bank, at the end of the next one
+	pc = 0x81FFF0;
+	bad = bad || testemit(rom, &pc, "bpl $810010", 0x10, 2);
+	bad = bad || testemit(rom, &pc, "brl $810020", 0x82, 3);
+	if (bad)
+	{
+		free(rom);
+		return -1;
+	}
+
+	// Header, reset vector and checksum
+	memcpy(rom + 0x7FC0, title, 21);
+	rom[0x7FD5] = 0x20;
+	rom[0x7FD6] = 0x00;
+	rom[0x7FD7] = 0x07;
+	rom[0x7FD8] = 0x00;
+	rom[0x7FD9] = 0x01;
+	rom[0x7FDA] = 0x33;
+	rom[0x7FDB] = 0x00;
+	rom[0x7FDC] = rom[0x7FDD] = 0xFF;
+	rom[0x7FDE] = rom[0x7FDF] = 0x00;
+	rom[0x7FFC] = 0x00;
+	rom[0x7FFD] = 0x80;
+	for (i=0, sum=0; i<0x20000; i++)
+	{
+		sum += rom[i];
+	}
+	rom[0x7FDE] = sum & 0xFF;
+	rom[0x7FDF] = (sum >> 8) & 0xFF;
+	rom[0x7FDC] = ~sum & 0xFF;
+	rom[0x7FDD] = (~sum >> 8) & 0xFF;
+
+	if ((f = fopen(file, "wb")) == NULL)
+	{
+		free(rom);
+		return -1;
+	}
+	i = fwrite(rom, 0x20000, 1, f);
+	free(rom);
+	return (fclose(f) == 0 && i == 1) ? 0 : -1;
+}
@@ -0,0 +1,117 @@
+/* cdl.c
+ * Code/data log module for DisPel
+ * Loads the code/data logs emulators write while a game runs, and turns
+ * them into the same code map the tracer builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Log flags, one byte per ROM byte (Mesen-S layout). The M/X bits sit
+// where they do in P, set for 8-bit.
+#define CDL_CODE	0x01	// executed, as an opcode or operand
+#define CDL_DATA	0x02	// read as data
+#define CDL_JUMP	0x04	// branch or jump target
+#define CDL_SUB		0x08	// subroutine entry point
+#define CDL_X8		0x10	// ran with 8-bit X/Y
+#define CDL_M8		0x20	// ran with 8-bit A
+
+// Longest header seen in front of the per-byte flags ("CDLv2" and a CRC)
+#define CDLHEAD		16
+
+/* loadcdl() - seeds an analysis from a code/data log
+ * Pre:  an   - analysis from aninit()
+ *       data - ROM image
+ *       len  - image length
+ *       map  - memory mapper for the image
+ *       file - name of the log, either the bare flags (one byte per image
+ *              byte) or the same behind a short "CDL" header
+ * Post: returns the number of instructions found, or -1 if the file
+ *       couldn't be read or doesn't fit the image. Logged code goes into
+ *       an->cmap as CM_LOGGED instructions at the logged widths, entry
+ *       points as targets; code and data also go into the access map.
+ */
+
+int loadcdl(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	const char *file)
+{
+	FILE *f;
+	unsigned char *cdl,c;
+	unsigned long size,skip,off,addr;
+	int i,offset,count=0;
+
+	if ((f = fopen(file, "rb")) == NULL)
+	{
+		return -1;
+	}
+	fseek(f, 0L, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0L, SEEK_SET);
+
+	if ((cdl = malloc(size + 1)) == NULL)
+	{
+		printf("Cant alloc %ld bytes.\n", size + 1);
+		exit(1);
+	}
+	if (fread(cdl, 1, size, f) != size)
+	{
+		size = 0;
+	}
+	fclose(f);
+
+	// Anything in front of the flags has to be a header
+	skip = 0;
+	if (size > len && size - len <= CDLHEAD && memcmp(cdl, "CDL", 3) == 0)
+	{
+		skip = size - len;
+	}
+	if (size - skip != len)
+	{
+		free(cdl);
+		return -1;
+	}
+
+	for (off=0; off<len; )
+	{
+		c = cdl[skip + off];
+		addr = off2snes(map, off);
+
+		if (!(c & CDL_CODE))
+		{
+			if ((c & CDL_DATA) && addr != NOADDR)
+			{
+				markaccess(an, addr, ACC_READ);
+			}
+			off++;
+			continue;
+		}
+
+		// The first code byte of a run is an opcode, and the widths it ran
+		// with say where the next one starts
+		offset = oplen[OPSTATE(c)][data[off]];
+		if (off + offset > len)
+		{
+			break;
+		}
+		an->cmap[off] |= CM_OP | CM_LOGGED | (c & 0x30) | ((c & (CDL_JUMP|CDL_SUB)) ? CM_TARGET : 0);
+		for (i=0; i<offset; i++)
+		{
+			if (i)
+			{
+				an->cmap[off+i] |= CM_OPERAND;
+			}
+			if (addr != NOADDR)
+			{
+				markaccess(an, (addr & 0xFF0000) | ((addr + i) & 0xFFFF), ACC_EXEC);
+			}
+		}
+		off += offset;
+		count++;
+	}
+
+	free(cdl);
+	return count;
+}
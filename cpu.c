@@ -0,0 +1,123 @@
+/* cpu.c
+ * CPU backend module for DisPel
+ * The table of processors DisPel can disassemble for, and the listing
+ * layout shared by the ones without an assembler of their own.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+/* unchanged() - state reset for processors that take the state as given */
+
+static unsigned short unchanged(unsigned short flag)
+{
+	return flag;
+}
+
+/* cleared() - state reset for processors that always start the same */
+
+static unsigned short cleared(unsigned short flag)
+{
+	return 0;
+}
+
+/* Backends, indexed by -1-RT_* */
+
+static const struct cpu cpus[] =
+{
+	{ "65816", scan, disasm, unchanged },
+	{ "spc700", spcscan, spcdisasm, cleared },
+	{ "6502", scan6502, dis6502, reset6502 },
+	{ "65c02", scan65c02, dis65c02, reset6502 },
+	{ "superfx", gsuscan, gsudisasm, cleared },
+};
+
+#define NCPU	(int)(sizeof(cpus) / sizeof(cpus[0]))
+
+/* cputype() - looks up a processor by name
+ * Pre:  name - processor name, e.g. "spc700"
+ * Post: returns its RT_* region type, or 0 if the name is unknown.
+ *       "code" and "spc" are taken for 65816 and spc700.
+ */
+
+int cputype(const char *name)
+{
+	int i;
+
+	if (strcmp(name, "code") == 0)
+	{
+		return RT_CODE;
+	}
+	if (strcmp(name, "spc") == 0)
+	{
+		return RT_SPC;
+	}
+	for (i=0; i<NCPU; i++)
+	{
+		if (strcmp(name, cpus[i].name) == 0)
+		{
+			return -1 - i;
+		}
+	}
+	return 0;
+}
+
+/* cpufor() - the backend for a region type
+ * Post: returns the backend, or NULL for data regions.
+ */
+
+const struct cpu *cpufor(int type)
+{
+	return (type < 0 && type >= -NCPU) ? &cpus[-1 - type] : NULL;
+}
+
+/* fmtline() - lays out one line for a backend
+ * Pre:  mem    - the instruction
+ *       pos    - its listing address
+ *       offset - its length, up to 4
+ *       name   - mnemonic
+ *       pbuf   - operands, or empty
+ *       tsrc   - as for disasm(). Assembler source gets the bytes as a db
+ *                line, with the instruction as a comment.
+ * Post: inst   - the formatted line, laid out as disasm() does.
+ */
+
+void fmtline(unsigned char *mem, unsigned long pos, int offset, const char *name, const char *pbuf,
+	char *inst, unsigned char tsrc)
+{
+	char hbuf[9],*p;
+	int i;
+
+	if (tsrc & 4)
+	{
+		p = inst + sprintf(inst, "db ");
+		for (i=0; i<offset; i++)
+		{
+			p += sprintf(p, "%s$%02X", i ? "," : "", mem[i]);
+		}
+		sprintf(p, "\t; %s%s%s", name, pbuf[0] ? " " : "", pbuf);
+		return;
+	}
+
+	if (tsrc & 1)
+	{
+		sprintf(inst, "%s %s", name, pbuf);
+		return;
+	}
+
+	// Generate hex output
+	for (i=0; i<offset; i++)
+	{
+		sprintf(hbuf+i*2,"%02X",mem[i]);
+	}
+	for (i=offset*2; i<8; i++)
+	{
+		hbuf[i]=0x20;
+	}
+	hbuf[8]=0;
+
+	sprintf(inst, "%02lX/%04lX:\t%s\t%s %s", (pos >> 16) & 0xFF, pos&0xFFFF, hbuf, name, pbuf);
+}
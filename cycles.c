@@ -0,0 +1,266 @@
+/* cycles.c
+ * Cycle counting module for DisPel
+ * Estimates what each 65816 instruction costs: CPU cycles, from the
+ * opcode and the A/X/Y sizes, and master clocks, from where its bytes and
+ * data are in the SNES memory map. What can't be known without running
+ * the code - branches taken, page crossings, D unknown - gives a range.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Cycles in native mode with 8-bit A and X/Y, D low byte 0, no page
+// crossed and branches not taken. MVN/MVP are per byte moved.
+static const unsigned char basecyc[256] =
+{
+	8,6,8,4,5,3,5,6,3,2,2,4,6,4,6,5,		// 00
+	2,5,5,7,5,4,6,6,2,4,2,2,6,4,7,5,		// 10
+	6,6,8,4,3,3,5,6,4,2,2,5,4,4,6,5,		// 20
+	2,5,5,7,4,4,6,6,2,4,2,2,4,4,7,5,		// 30
+	7,6,2,4,7,3,5,6,3,2,2,3,3,4,6,5,		// 40
+	2,5,5,7,7,4,6,6,2,4,3,2,4,4,7,5,		// 50
+	6,6,6,4,3,3,5,6,4,2,2,6,5,4,6,5,		// 60
+	2,5,5,7,4,4,6,6,2,4,4,2,6,4,7,5,		// 70
+	3,6,4,4,3,3,3,6,2,2,2,3,4,4,4,5,		// 80
+	2,6,5,7,4,4,4,6,2,5,2,2,4,5,5,5,		// 90
+	2,6,2,4,3,3,3,6,2,2,2,4,4,4,4,5,		// A0
+	2,5,5,7,4,4,4,6,2,4,2,2,4,4,4,5,		// B0
+	2,6,3,4,3,3,5,6,2,2,2,3,4,4,6,5,		// C0
+	2,5,5,7,6,4,6,6,2,4,3,3,6,4,7,5,		// D0
+	2,6,3,4,3,3,5,6,2,2,2,3,4,4,6,5,		// E0
+	2,5,5,7,5,4,6,6,2,4,4,2,8,4,7,5			// F0
+};
+
+/* mwide() - does 16-bit A cost the instruction more cycles?
+ * Post: returns 2 for read-modify-write of memory, 1 for other accesses
+ *       sized by A, 0 otherwise.
+ */
+
+static int mwide(unsigned char op)
+{
+	switch (op)
+	{
+	case 0x04: case 0x0C: case 0x14: case 0x1C:		// TSB/TRB
+	case 0x06: case 0x0E: case 0x16: case 0x1E:		// ASL
+	case 0x26: case 0x2E: case 0x36: case 0x3E:		// ROL
+	case 0x46: case 0x4E: case 0x56: case 0x5E:		// LSR
+	case 0x66: case 0x6E: case 0x76: case 0x7E:		// ROR
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE:		// DEC
+	case 0xE6: case 0xEE: case 0xF6: case 0xFE:		// INC
+		return 2;
+	case 0x24: case 0x2C: case 0x34: case 0x3C:		// BIT
+	case 0x64: case 0x74: case 0x9C: case 0x9E:		// STZ
+	case 0x48: case 0x68:							// PHA/PLA
+		return 1;
+	}
+	// ORA/AND/EOR/ADC/STA/LDA/CMP/SBC, every mode
+	switch (op & 0x1F)
+	{
+	case 0x01: case 0x03: case 0x05: case 0x07: case 0x09: case 0x0D: case 0x0F:
+	case 0x11: case 0x12: case 0x13: case 0x15: case 0x17: case 0x19: case 0x1D: case 0x1F:
+		return 1;
+	}
+	return 0;
+}
+
+/* xwide() - does 16-bit X/Y cost the instruction a cycle? */
+
+static int xwide(unsigned char op)
+{
+	switch (op)
+	{
+	case 0xA0: case 0xA2: case 0xA4: case 0xA6: case 0xAC: case 0xAE:	// LDX/LDY
+	case 0xB4: case 0xB6: case 0xBC: case 0xBE:
+	case 0x84: case 0x86: case 0x8C: case 0x8E: case 0x94: case 0x96:	// STX/STY
+	case 0xC0: case 0xC4: case 0xCC: case 0xE0: case 0xE4: case 0xEC:	// CPX/CPY
+	case 0x5A: case 0x7A: case 0xDA: case 0xFA:							// PHY/PLY/PHX/PLX
+		return 1;
+	}
+	return 0;
+}
+
+/* stackop() - does the instruction's data go to or from the stack? */
+
+static int stackop(unsigned char op)
+{
+	switch (op)
+	{
+	case 0x00: case 0x02: case 0x08: case 0x0B: case 0x20: case 0x22: case 0x28: case 0x2B:
+	case 0x40: case 0x48: case 0x4B: case 0x5A: case 0x60: case 0x62: case 0x68: case 0x6B:
+	case 0x7A: case 0x8B: case 0xAB: case 0xD4: case 0xDA: case 0xF4: case 0xFA: case 0xFC:
+		return 1;
+	}
+	return 0;
+}
+
+/* memspeed() - master clocks for one access to an address
+ * Pre:  fast - 1 if banks $80-$FF run ROM at FastROM speed
+ * Post: returns 6, 8 or 12.
+ */
+
+static int memspeed(unsigned long addr, int fast)
+{
+	unsigned long bank = (addr >> 16) & 0xFF, a = addr & 0xFFFF;
+
+	if (bank >= 0x40 && bank < 0x80)
+	{
+		return 8;
+	}
+	if (bank >= 0xC0 || a >= 0x8000)
+	{
+		return (fast && bank >= 0x80) ? 6 : 8;
+	}
+	if (a < 0x2000 || a >= 0x6000)
+	{
+		return 8;		// WRAM, expansion
+	}
+	if (a >= 0x4000 && a < 0x4200)
+	{
+		return 12;		// old-style joypad registers
+	}
+	return 6;
+}
+
+/* opcost() - estimates the cost of one 65816 instruction
+ * Pre:  mem  - the instruction
+ *       pc   - its address
+ *       flag - processor state it runs in
+ *       ctx  - D/DBR context, see CTX_*, or 0 if not known
+ *       fast - 1 for FastROM
+ * Post: c    - least and most CPU cycles and master clocks. Opcode and
+ *              operand bytes are fetched at the speed of the code's
+ *              address; the other cycles of stack instructions at WRAM
+ *              speed, of instructions that access data at its address's
+ *              speed (WRAM/SlowROM speed when it isn't known), and of
+ *              everything else at internal operation speed.
+ */
+
+void opcost(unsigned char *mem, unsigned long pc, unsigned short flag, unsigned long ctx, int fast,
+	struct cost *c)
+{
+	unsigned char op = mem[0];
+	int mode = opmode[op], len = oplen[OPSTATE(flag)][op], emu = (flag & FLAG_E) != 0;
+	int extra = 0, maybe = 0, fetch, rest;
+	long ea;
+
+	// 16-bit A and X/Y
+	if (!(flag & 0x20))
+	{
+		extra += mwide(op);
+	}
+	if (!(flag & 0x10))
+	{
+		extra += xwide(op);
+	}
+
+	switch (mode)
+	{
+	case AM_DP:
+	case AM_DPX:
+	case AM_DPY:
+	case AM_DPIND:
+	case AM_DPINDL:
+	case AM_DPINDX:
+	case AM_DPINDY:
+	case AM_DPINDLY:
+	case AM_SR:
+		// D low byte not 0
+		if (mode != AM_SR && !(ctx & CTX_D))
+		{
+			maybe++;
+		}
+		else if (mode != AM_SR && (ctx & 0xFF))
+		{
+			extra++;
+		}
+		if (mode != AM_DPINDY)
+		{
+			break;
+		}
+		// fall through
+	case AM_ABSX:
+	case AM_ABSY:
+		// Indexed reads crossing a page; stores and read-modify-writes
+		// always take the cycle, which is in the base count
+		if (op == 0x91 || op == 0x99 || op == 0x9D || op == 0x9E || mwide(op) == 2)
+		{
+			break;
+		}
+		if (!(flag & 0x10))
+		{
+			extra++;
+		}
+		else if (mode == AM_DPINDY || mem[1] != 0)
+		{
+			maybe++;
+		}
+		break;
+	case AM_REL:
+		// Taken, and in emulation mode to another page
+		if (op != 0x80)
+		{
+			maybe++;
+		}
+		if (emu && ((pc + 2 + (signed char)mem[1]) & 0xFF00) != ((pc + 2) & 0xFF00))
+		{
+			if (op == 0x80)
+			{
+				extra++;
+			}
+			else
+			{
+				maybe++;
+			}
+		}
+		break;
+	}
+	// No bank byte pushed or pulled in emulation mode
+	if (emu && (op == 0x00 || op == 0x02 || op == 0x40))
+	{
+		extra--;
+	}
+
+	c->lo = basecyc[op] + extra;
+	c->hi = c->lo + maybe;
+
+	// Master clocks: fetches, then the rest at the speed of what they touch
+	fetch = memspeed(pc, fast);
+	if (stackop(op))
+	{
+		rest = 8;
+	}
+	else if (mode <= AM_SIG || mode == AM_REL || mode == AM_RELL)
+	{
+		rest = 6;
+	}
+	else
+	{
+		ea = (mode == AM_LONG || mode == AM_LONGX) ? (long)(mem[1] | (mem[2] << 8) | (mem[3] << 16)) : effaddr(mem, ctx);
+		rest = (ea >= 0) ? memspeed(ea, fast) : 8;
+	}
+	c->clo = len * fetch + (c->lo - len) * rest;
+	c->chi = len * fetch + (c->hi - len) * rest;
+}
+
+/* endsblock() - does an instruction end a basic block?
+ * Post: 1 for branches, jumps, returns, BRK/COP and STP. Calls don't; the
+ *       block carries on after them.
+ */
+
+int endsblock(unsigned char op)
+{
+	if (opmode[op] == AM_REL)
+	{
+		return 1;
+	}
+	switch (op)
+	{
+	case 0x00: case 0x02: case 0x40: case 0x4C: case 0x5C: case 0x60: case 0x6B:
+	case 0x6C: case 0x7C: case 0x82: case 0xDB: case 0xDC:
+		return 1;
+	}
+	return 0;
+}
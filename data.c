@@ -0,0 +1,221 @@
+/* data.c
+ * Data formatting module for DisPel
+ * Lists the bytes outside code as assembler data directives - db/dw/dl
+ * blocks, 16/24-bit code pointers, and text through a character table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Shortest run of table characters that's output as text
+#define MINTEXT		4
+// Longest text output on one line, in characters
+#define TEXTLINE	64
+
+static const char *fmtnames[DF_COUNT] =
+{
+	"hex", "db", "dw", "dl", "ptr", "lptr"
+};
+
+// Character table, from loadtbl()
+static char *chartab[256];
+
+/* dataformat() - looks up a data format by name
+ * Pre:  name - format name, e.g. "dw"
+ * Post: returns the DF_* format, or -1 if the name is unknown.
+ */
+
+int dataformat(const char *name)
+{
+	int i;
+
+	for (i=0; i<DF_COUNT; i++)
+	{
+		if (strcmp(name, fmtnames[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char *fmttitle(int type)
+{
+	return (type >= 0 && type < DF_COUNT) ? fmtnames[type] : "unknown";
+}
+
+/* loadtbl() - loads a character table
+ * Pre:  file - table file, with lines of the form "41=A" (hex byte, then
+ *              the text it stands for)
+ * Post: returns the number of entries loaded, or -1 if the file couldn't
+ *       be read. Lines that don't fit the form are skipped.
+ */
+
+int loadtbl(const char *file)
+{
+	FILE *f;
+	char line[256];
+	unsigned int code;
+	int n,count=0;
+
+	if ((f = fopen(file, "r")) == NULL)
+	{
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = 0;
+		if (sscanf(line, "%2X=%n", &code, &n) < 1 || line[2] != '=' || line[n] == 0)
+		{
+			continue;
+		}
+		// Quotes can't go in a string, so they stay bytes
+		if (strchr(line + n, '"') != NULL)
+		{
+			continue;
+		}
+		free(chartab[code]);
+		if ((chartab[code] = malloc(strlen(line + n) + 1)) == NULL)
+		{
+			printf("Cant alloc character table.\n");
+			exit(1);
+		}
+		strcpy(chartab[code], line + n);
+		count++;
+	}
+	fclose(f);
+	return count;
+}
+
+void freetbl(void)
+{
+	int i;
+
+	for (i=0; i<256; i++)
+	{
+		free(chartab[i]);
+		chartab[i] = NULL;
+	}
+}
+
+/* textrun() - counts the table characters at the start of some data
+ * Post: returns the number of leading bytes (up to n) in the table.
+ */
+
+static unsigned long textrun(unsigned char *data, unsigned long n)
+{
+	unsigned long i;
+
+	for (i=0; i<n && chartab[data[i]] != NULL; i++);
+	return i;
+}
+
+/* ptrtarget() - the address a pointer in data points to
+ * Pre:  data - pointer to the bytes, n of them
+ *       type - DF_PTR or DF_LPTR
+ *       ptr  - as for fmtdata()
+ * Post: returns the target, or NOADDR if there isn't a whole pointer.
+ */
+
+unsigned long ptrtarget(unsigned char *data, unsigned long pos, unsigned long n, int type, unsigned long ptr)
+{
+	if (type == DF_LPTR)
+	{
+		return (n < 3) ? NOADDR : (unsigned long)(data[0] | (data[1] << 8) | (data[2] << 16));
+	}
+	if (type != DF_PTR || n < 2)
+	{
+		return NOADDR;
+	}
+	return (ptr != NOADDR) ? ptr & 0xFFFFFF : (pos & 0xFF0000) | data[0] | (data[1] << 8);
+}
+
+/* fmtdata() - formats one line of data
+ * Pre:  data  - pointer to the bytes
+ *       pos   - their listing address
+ *       n     - number of bytes available for this line (at least 1)
+ *       type  - DF_* format, other than DF_HEX
+ *       ptr   - for DF_PTR, the target of the pointer (NOADDR to take it
+ *               from the bank of pos)
+ *       label - for DF_PTR/DF_LPTR, the target's label, or NULL
+ *       tsrc  - 1 if addresses are to be suppressed
+ * Post: inst  - the formatted line
+ *       returns the number of bytes used. With a character table loaded,
+ *       runs of table characters are output as text whatever the type,
+ *       and other lines stop short of them.
+ */
+
+int fmtdata(unsigned char *data, unsigned long pos, unsigned long n, int type, unsigned long ptr,
+	const char *label, char *inst, unsigned char tsrc)
+{
+	unsigned long i,run,width,chars;
+	char *p;
+
+	p = inst;
+	if (!(tsrc & 1))
+	{
+		p += sprintf(p, "%02lX/%04lX:\t        \t", (pos >> 16) & 0xFF, pos & 0xFFFF);
+	}
+
+	// Text
+	if ((run = textrun(data, n)) >= MINTEXT)
+	{
+		p += sprintf(p, "db \"");
+		for (i=0, chars=0; i<run && (i == 0 || chars + strlen(chartab[data[i]]) <= TEXTLINE); i++)
+		{
+			chars += strlen(chartab[data[i]]);
+			p += sprintf(p, "%s", chartab[data[i]]);
+		}
+		sprintf(p, "\"");
+		return i;
+	}
+
+	// Don't run into text
+	for (run=1; run<n && textrun(data + run, n - run) < MINTEXT; run++);
+
+	switch (type)
+	{
+	case DF_PTR:
+	case DF_LPTR:
+		width = (type == DF_PTR) ? 2 : 3;
+		if (run < width)
+		{
+			break;
+		}
+		i = data[0] | (data[1] << 8) | (width == 3 ? data[2] << 16 : 0);
+		p += sprintf(p, (width == 2) ? "dw $%04lX\t; $%06lX" : "dl $%06lX\t; $%06lX", i,
+			ptrtarget(data, pos, run, type, ptr));
+		if (label != NULL)
+		{
+			sprintf(p, " %s", label);
+		}
+		return width;
+	case DF_WORD:
+	case DF_LONG:
+		width = (type == DF_WORD) ? 2 : 3;
+		if (run < width)
+		{
+			break;
+		}
+		run = (run / width > 4) ? 4 : run / width;
+		p += sprintf(p, "%s ", fmtnames[type]);
+		for (i=0; i<run; i++)
+		{
+			p += sprintf(p, (width == 2) ? "%s$%04X" : "%s$%06X", i ? "," : "",
+				data[i*width] | (data[i*width+1] << 8) | (width == 3 ? data[i*width+2] << 16 : 0));
+		}
+		return run * width;
+	}
+
+	// Bytes, and the odd ends of words and pointers
+	run = (run > 8) ? 8 : run;
+	p += sprintf(p, "db ");
+	for (i=0; i<run; i++)
+	{
+		p += sprintf(p, "%s$%02X", i ? "," : "", data[i]);
+	}
+	return run;
+}
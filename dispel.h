@@ -4,4 +4,343 @@
  * Created 240900
  */
 
-int disasm(unsigned char *mem, unsigned long pos, unsigned char *flag, char *inst, unsigned char tsrc);
+// Code map flags, one byte per file offset. Bits 0x10/0x20 hold the
+// X/M flags in effect at each CM_OP byte.
+#define CM_OP		0x01	// first byte of an instruction
+#define CM_OPERAND	0x02	// operand byte of an instruction
+#define CM_TARGET	0x04	// branch, call or jump table target
+#define CM_PTR		0x08	// jump table entry
+#define CM_EMU		0x40	// instruction runs in emulation mode
+#define CM_LOGGED	0x80	// instruction from a code/data log, not traced yet
+
+// Processor state: the P register in the low byte, plus the emulation flag
+#define FLAG_E		0x100
+
+// Index into oplen[] for a processor state
+#define OPSTATE(flag)	(((flag) >> 4) & 3)
+
+// Addressing modes, as found in opmode[]
+#define AM_IMP		0	// implied, stack
+#define AM_ACC		1	// A
+#define AM_IMM8		2	// #$xx (REP/SEP)
+#define AM_IMMM		3	// #$xx/#$xxxx by A size
+#define AM_IMMX		4	// #$xx/#$xxxx by X/Y size
+#define AM_SIG		5	// $xx (BRK/COP/WDM signature)
+#define AM_DP		6	// $xx
+#define AM_DPX		7	// $xx,X
+#define AM_DPY		8	// $xx,Y
+#define AM_DPIND	9	// ($xx), also PEI
+#define AM_DPINDL	10	// [$xx]
+#define AM_DPINDX	11	// ($xx,X)
+#define AM_DPINDY	12	// ($xx),Y
+#define AM_DPINDLY	13	// [$xx],Y
+#define AM_SR		14	// $xx,S
+#define AM_SRINDY	15	// ($xx,S),Y
+#define AM_ABS		16	// $xxxx
+#define AM_ABSX		17	// $xxxx,X
+#define AM_ABSY		18	// $xxxx,Y
+#define AM_ABSIND	19	// ($xxxx)
+#define AM_ABSINDX	20	// ($xxxx,X)
+#define AM_ABSINDL	21	// [$xxxx]
+#define AM_LONG		22	// $xxxxxx
+#define AM_LONGX	23	// $xxxxxx,X
+#define AM_STKABS	24	// $xxxx (PEA)
+#define AM_REL		25	// 8-bit branch
+#define AM_RELL		26	// 16-bit branch (BRL/PER)
+#define AM_MOVE		27	// $xx,$xx (MVN/MVP)
+
+// Data formats, for the bytes outside code
+#define DF_HEX		0	// bare hex, as -d
+#define DF_BYTE		1	// db
+#define DF_WORD		2	// dw
+#define DF_LONG		3	// dl
+#define DF_PTR		4	// dw, annotated with the code address it points to
+#define DF_LPTR		5	// dl, likewise
+#define DF_COUNT	6
+
+// Region types for code, one per CPU backend; data regions use the DF_*
+// formats
+#define RT_CODE		(-1)	// 65816
+#define RT_SPC		(-2)	// SPC700, listed at its APU RAM address
+#define RT_6502		(-3)	// NMOS 6502
+#define RT_65C02	(-4)	// 65C02
+#define RT_GSU		(-5)	// SuperFX
+
+// One range of a region file
+struct region
+{
+	unsigned long start,end;	// SNES addresses as read, file offsets once placed
+	int type;					// RT_* CPU, or the DF_* format of data
+	unsigned short flag;		// processor state at the start of code
+	unsigned long origin;		// listing address of the start, or $1000000 if none
+	char name[32];				// label for the start, or empty
+};
+
+// CPU backend, chosen once per region
+struct cpu
+{
+	const char *name;
+	// Length-only walk of instruction boundaries, as scan()
+	unsigned long (*scan)(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+		unsigned char *marks);
+	// Decode and format one instruction, as disasm()
+	int (*disasm)(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+		unsigned char tsrc);
+	// Processor state at the start of a region, from the one asked for
+	unsigned short (*reset)(unsigned short flag);
+};
+
+// Memory mappers
+#define MAP_LOROM	0
+#define MAP_HIROM	1
+#define MAP_EXHIROM	2
+#define MAP_EXLOROM	3
+#define MAP_SA1		4
+#define MAP_SUPERFX	5
+#define MAP_COUNT	6
+
+// off2snes() result for offsets with no SNES address
+#define NOADDR		0xFFFFFFFFUL
+
+struct mapper
+{
+	int type;
+	unsigned long len;
+	long fwd[512];			// file offset of each 32K half-bank, or -1
+	unsigned long *rev;		// listing address of each 32K chunk of the image
+	unsigned long nrev;
+};
+
+// Instruction context in analysis ctx[] entries: D in bits 0-15, DBR in 16-23.
+// The entry for the first byte of a jump table entry holds its target instead.
+#define CTX_D		0x1000000UL	// D is known
+#define CTX_DBR		0x2000000UL	// DBR is known
+
+// Code tracing entry point
+struct entry
+{
+	unsigned long addr;
+	unsigned short flag;	// processor state
+	unsigned long ctx;		// D/DBR, see CTX_*
+};
+
+// Results of execute()
+struct execrun
+{
+	struct entry *found;		// code reached that the trace hadn't found
+	int nfound;
+	unsigned long steps;		// instructions run
+	unsigned long conflicts;	// instructions run at other widths than traced
+};
+
+// Access map planes
+#define ACC_READ	0
+#define ACC_WRITE	1
+#define ACC_EXEC	2
+#define ACC_KINDS	3
+
+// Bump allocator, see aalloc()
+struct ablock;
+struct arena
+{
+	struct ablock *head;		// block being filled
+	unsigned long size;			// bytes in all blocks
+	unsigned long used;			// bytes handed out
+	int nblock;
+	double secs;				// time spent getting blocks from the system
+};
+
+// Results of code tracing
+struct analysis
+{
+	unsigned char *cmap;		// CM_* flags per file offset
+	unsigned long *ctx;			// D/DBR context per instruction, see CTX_*
+	unsigned char *access[ACC_KINDS][256];	// per-bank bitmaps, see markaccess()
+	struct arena arena;			// where all of the above comes from
+};
+
+// Result of header detection
+struct romhead
+{
+	int mapping;			// MAP_* type
+	long skip;				// copier header size, 0 or $200
+	long header;			// offset of the header in the image, or -1
+	int score;
+	int sumok;				// 1 if the header checksum matched the image
+};
+
+// Estimated cost of an instruction or run of them, from opcost()
+struct cost
+{
+	unsigned int lo, hi;			// CPU cycles
+	unsigned long clo, chi;			// master clocks
+};
+
+// Output profile, from compileprofile()
+struct profile
+{
+	unsigned char op[12];		// emitter steps
+	unsigned char col[12];		// column each padding step pads to
+	int nop;
+	int addr;					// address style
+	char hex[3];				// prefix for hex numbers
+	int upper;					// uppercase mnemonics
+	int pad;					// pad the bytes to a tab stop
+};
+
+// Output options for listregion()
+struct listing
+{
+	FILE *fout;
+	unsigned char *data;		// ROM image
+	unsigned long len;
+	struct mapper *map;
+	struct analysis *an;		// code map and contexts, or NULL if not traced
+	unsigned char tsrc;			// as for disasm()
+	unsigned char bound;		// 1 to stop instructions at bank boundaries
+	unsigned int dwidth;		// hexdump width, or 0 to disassemble
+	int dformat;				// DF_* format of untraced bytes
+	unsigned long checked;		// bytes checked against the assembler
+	unsigned long differ;		// lines that didn't assemble back
+	struct profile *profile;	// line layout, or NULL for the usual one
+	unsigned char cycles;		// 1 to annotate 65816 code with its cost
+	unsigned char fast;			// 1 for FastROM
+	struct region *region;		// all the regions, for labels
+	int nregion;
+};
+
+// Search pattern, from compilepat()
+#define PATMAX		16		// most instructions in a pattern
+struct patelem
+{
+	unsigned char ops[32];		// bitmap of the opcodes the mnemonic matches
+	char operand[24];			// operand to match, with ?/* wildcards
+};
+struct pattern
+{
+	struct patelem elem[PATMAX];
+	int n;
+};
+
+// Longest output of assemble()
+#define ASMMAX		256
+
+extern const unsigned char oplen[4][256];
+extern const unsigned char opmode[256];
+extern const char opname[256][4];
+
+int disasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc);
+int stepflag(unsigned char *mem, unsigned long avail, unsigned short *flag);
+const char *mnemonic(unsigned char op, unsigned char tsrc);
+unsigned long scan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks);
+
+int cputype(const char *name);
+const struct cpu *cpufor(int type);
+void fmtline(unsigned char *mem, unsigned long pos, int offset, const char *name, const char *pbuf,
+	char *inst, unsigned char tsrc);
+
+extern const unsigned char spclen[256];
+extern const char spcname[256][6];
+
+unsigned long spcscan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks);
+int spcdisasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc);
+int spcfind(unsigned char *data, unsigned long len, struct region **list);
+
+unsigned short reset6502(unsigned short flag);
+unsigned long scan6502(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks);
+unsigned long scan65c02(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks);
+int dis6502(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc);
+int dis65c02(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc);
+
+unsigned long gsuscan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks);
+int gsudisasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc);
+
+int mapname(const char *name);
+const char *maptitle(int type);
+int mapdirective(const char *name);
+const char *mapasm(int type);
+long mapheader(int type);
+void mapinit(struct mapper *map, int type, unsigned long len, int shadow);
+void mapfree(struct mapper *map);
+long snes2off(struct mapper *map, unsigned long addr);
+unsigned long off2snes(struct mapper *map, unsigned long off);
+long mapfirst(struct mapper *map, unsigned long addr, unsigned long last);
+long maplast(struct mapper *map, unsigned long addr, unsigned long first);
+
+void detect(unsigned char *data, unsigned long len, long skip, int mapping, struct romhead *hd);
+
+void *aalloc(struct arena *a, unsigned long n);
+void afree(struct arena *a);
+long peakrss(void);
+
+void aninit(struct analysis *an, unsigned long len);
+void trace(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct entry *entry, int nentry);
+void anfree(struct analysis *an);
+long effaddr(unsigned char *mem, unsigned long ctx);
+unsigned long foldaddr(unsigned long addr);
+void markaccess(struct analysis *an, unsigned long addr, int kind);
+int accessed(struct analysis *an, unsigned long addr, int kind);
+int savemap(struct analysis *an, const char *file);
+void execute(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct entry *entry, int nentry, unsigned long steps, struct execrun *run);
+int datarun(unsigned char *cmap, unsigned long pos, unsigned long rpos, unsigned long len, unsigned long end);
+
+int dataformat(const char *name);
+const char *fmttitle(int type);
+int loadtbl(const char *file);
+void freetbl(void);
+unsigned long ptrtarget(unsigned char *data, unsigned long pos, unsigned long n, int type, unsigned long ptr);
+int fmtdata(unsigned char *data, unsigned long pos, unsigned long n, int type, unsigned long ptr,
+	const char *label, char *inst, unsigned char tsrc);
+
+int addrlabel(struct listing *ls, unsigned long off, char *name);
+void listregion(struct listing *ls, struct region *rg);
+void serve(struct listing *ls, struct region *region, int nregion);
+
+void opcost(unsigned char *mem, unsigned long pc, unsigned short flag, unsigned long ctx, int fast,
+	struct cost *c);
+int endsblock(unsigned char op);
+
+long loadcounts(const char *file, struct mapper *map, unsigned long len);
+void freecounts(void);
+unsigned long hotloops(struct listing *ls, unsigned long top);
+
+int compileprofile(const char *spec, struct profile *pf);
+void emitline(const struct profile *pf, char *out, unsigned long pos, const unsigned char *bytes, int n,
+	const char *body);
+
+int compilepat(const char *text, struct pattern *pat);
+unsigned long search(struct listing *ls, struct region *rg, struct pattern *pat);
+
+int loadregions(const char *file, unsigned short flag, struct region **list);
+int splitregions(struct region **list, int n, struct region *cut, int ncut);
+int parseblocks(const char *text, int bank, struct region **list, int *n, int *size);
+int mergeregions(struct region *list, int n);
+
+int loadsigs(const char *file);
+void freesigs(void);
+int savesigs(struct analysis *an, unsigned char *data, unsigned long len, struct region *region, int nregion,
+	const char *file);
+int namesigs(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct region *region, int nregion, struct region **list);
+
+FILE *zopen(const char *file);
+unsigned char *gunzip(const unsigned char *in, unsigned long inlen, unsigned long *outlen);
+
+int assemble(const char *line, unsigned long pc, unsigned char *out);
+int asmfile(const char *file, unsigned char *data, unsigned long len, struct mapper *map);
+int maketest(const char *file);
+
+int loadcdl(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	const char *file);
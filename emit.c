@@ -0,0 +1,267 @@
+/* emit.c
+ * Output profile module for DisPel
+ * Lays out listing lines to a profile chosen on the commandline - address
+ * style, hex prefix, mnemonic case, tabs or fixed columns. The profile is
+ * compiled once into a short list of steps; each line then just runs the
+ * steps, copying and padding fields without any format string parsing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "dispel.h"
+
+// Emitter steps
+#define EM_ADDR		0		// listing address, in the profile's style
+#define EM_BYTES	1		// instruction bytes in hex
+#define EM_BODY		2		// mnemonic and operand, or data directive
+#define EM_COMMENT	3		// "; " and the comment, if there is one
+#define EM_TAB		4		// a tab
+#define EM_COL		5		// spaces up to a column (at least one)
+
+// Address styles
+#define AD_SLASH	0		// 80/8000:
+#define AD_COLON	1		// 80:8000
+#define AD_FLAT		2		// 808000
+#define AD_NONE		3
+
+static const char hexdig[] = "0123456789ABCDEF";
+
+/* option() - matches one profile keyword
+ * Pre:  p   - the keyword, up to a ',' or the end
+ *       key - keyword to match, ending in '=' if it takes a value
+ * Post: returns a pointer to the value (or past the keyword), or NULL.
+ */
+
+static const char *option(const char *p, const char *key)
+{
+	int n = strlen(key);
+
+	if (strncmp(p, key, n) != 0 || (key[n-1] != '=' && p[n] != ',' && p[n] != 0))
+	{
+		return NULL;
+	}
+	return p + n;
+}
+
+/* compileprofile() - compiles an output profile
+ * Pre:  spec - comma-separated keywords: addr=slash|colon|flat|none,
+ *              hex=$|0x, upper, nobytes, cols[=<bytes>:<body>:<comment>]
+ * Post: pf   - the emitter steps for the profile
+ *       returns 0, or -1 for a keyword it doesn't know.
+ */
+
+int compileprofile(const char *spec, struct profile *pf)
+{
+	const char *p,*v;
+	int cols=0,bytes=1,c[3]={ 10, 20, 40 };
+
+	memset(pf, 0, sizeof(struct profile));
+	strcpy(pf->hex, "$");
+
+	for (p=spec; *p; p+=strcspn(p, ","), p+=(*p == ','))
+	{
+		if ((v = option(p, "addr=")) != NULL)
+		{
+			pf->addr = (strncmp(v, "slash", 5) == 0) ? AD_SLASH : (strncmp(v, "colon", 5) == 0) ? AD_COLON :
+				(strncmp(v, "flat", 4) == 0) ? AD_FLAT : (strncmp(v, "none", 4) == 0) ? AD_NONE : -1;
+			if (pf->addr < 0)
+			{
+				return -1;
+			}
+		}
+		else if ((v = option(p, "hex=")) != NULL)
+		{
+			if (v[0] == '$')
+			{
+				strcpy(pf->hex, "$");
+			}
+			else if (strncmp(v, "0x", 2) == 0)
+			{
+				strcpy(pf->hex, "0x");
+			}
+			else
+			{
+				return -1;
+			}
+		}
+		else if (option(p, "upper") != NULL)
+		{
+			pf->upper = 1;
+		}
+		else if (option(p, "nobytes") != NULL)
+		{
+			bytes = 0;
+		}
+		else if ((v = option(p, "cols=")) != NULL)
+		{
+			if (sscanf(v, "%d:%d:%d", &c[0], &c[1], &c[2]) != 3 || c[0] < 1 || c[1] <= c[0] || c[2] <= c[1] || c[2] > 255)
+			{
+				return -1;
+			}
+			cols = 1;
+		}
+		else if (option(p, "cols") != NULL)
+		{
+			cols = 1;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+
+	// Address, bytes, body and comment, separated by tabs or padded to columns
+	if (pf->addr != AD_NONE)
+	{
+		pf->op[pf->nop++] = EM_ADDR;
+	}
+	if (bytes)
+	{
+		if (pf->nop)
+		{
+			pf->col[pf->nop] = c[0];
+			pf->op[pf->nop++] = cols ? EM_COL : EM_TAB;
+		}
+		pf->op[pf->nop++] = EM_BYTES;
+	}
+	if (pf->nop)
+	{
+		pf->col[pf->nop] = bytes ? c[1] : c[0];
+		pf->op[pf->nop++] = cols ? EM_COL : EM_TAB;
+	}
+	pf->op[pf->nop++] = EM_BODY;
+	pf->col[pf->nop] = c[2];
+	pf->op[pf->nop++] = cols ? EM_COL : EM_TAB;
+	pf->op[pf->nop++] = EM_COMMENT;
+	pf->pad = !cols;
+	return 0;
+}
+
+/* hexcopy() - copies text, with the profile's prefix for hex numbers
+ * Post: returns the end of the copy. Quoted text is copied as it is.
+ */
+
+static char *hexcopy(const struct profile *pf, char *out, const char *p, const char *end)
+{
+	int quoted = 0;
+
+	for (; p<end; p++)
+	{
+		if (*p == '"')
+		{
+			quoted ^= 1;
+		}
+		if (*p == '$' && !quoted && pf->hex[0] != '$')
+		{
+			*out++ = pf->hex[0];
+			*out++ = pf->hex[1];
+		}
+		else if (*p != '\n')
+		{
+			*out++ = *p;
+		}
+	}
+	return out;
+}
+
+/* emitline() - lays out one listing line to a profile
+ * Pre:  pos   - listing address
+ *       bytes - bytes to show in hex, n of them (0 for data lines)
+ *       body  - instruction or directive, as output with -t, optionally
+ *               followed by "\t; " and a comment. A newline in it (from
+ *               -p) becomes a blank line after this one.
+ * Post: out   - the line, without a newline.
+ */
+
+void emitline(const struct profile *pf, char *out, unsigned long pos, const unsigned char *bytes, int n,
+	const char *body)
+{
+	const char *comment,*bodyend,*p;
+	char *line = out;
+	int i,s;
+
+	comment = strstr(body, "\t; ");
+	bodyend = (comment != NULL) ? comment : body + strlen(body);
+	// Instructions with no operand end in a space
+	while (bodyend > body && (bodyend[-1] == ' ' || bodyend[-1] == '\n'))
+	{
+		bodyend--;
+	}
+
+	for (s=0; s<pf->nop; s++)
+	{
+		switch (pf->op[s])
+		{
+		case EM_ADDR:
+			for (i=20; i>=0; i-=4)
+			{
+				*out++ = hexdig[(pos >> i) & 0xF];
+				if (i == 16 && pf->addr != AD_FLAT)
+				{
+					*out++ = (pf->addr == AD_SLASH) ? '/' : ':';
+				}
+			}
+			if (pf->addr == AD_SLASH)
+			{
+				*out++ = ':';
+			}
+			break;
+		case EM_BYTES:
+			for (i=0; i<n; i++)
+			{
+				*out++ = hexdig[bytes[i] >> 4];
+				*out++ = hexdig[bytes[i] & 0xF];
+			}
+			// With tabs, the bytes take up a tab stop's worth
+			for (i=n*2; pf->pad && i<8; i++)
+			{
+				*out++ = ' ';
+			}
+			break;
+		case EM_BODY:
+			p = body;
+			if (pf->upper)
+			{
+				for (; p<bodyend && *p != ' '; p++)
+				{
+					*out++ = toupper((unsigned char)*p);
+				}
+			}
+			out = hexcopy(pf, out, p, bodyend);
+			break;
+		case EM_COMMENT:
+			if (comment != NULL)
+			{
+				*out++ = ';';
+				*out++ = ' ';
+				out = hexcopy(pf, out, comment + 3, comment + strlen(comment));
+			}
+			break;
+		case EM_TAB:
+			*out++ = '\t';
+			break;
+		case EM_COL:
+			do
+			{
+				*out++ = ' ';
+			} while (out - line < pf->col[s]);
+			break;
+		}
+	}
+
+	// Separators with nothing after them
+	while (out > line && (out[-1] == ' ' || out[-1] == '\t'))
+	{
+		out--;
+	}
+
+	// -p's blank line after returns
+	if (strchr(body, '\n') != NULL)
+	{
+		*out++ = '\n';
+	}
+	*out = 0;
+}
@@ -0,0 +1,720 @@
+/* exec.c
+ * Execution module for DisPel
+ * Runs the code from each entry point on a bare 65816 - registers, flags,
+ * stack, WRAM and the ROM, no PPU/APU - for a bounded number of steps, to
+ * find the code that computed jumps, pushed return addresses and PLP/RTI
+ * flag changes lead to. What it reaches goes back to trace().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// P register flags
+#define P_C		0x01
+#define P_Z		0x02
+#define P_I		0x04
+#define P_D		0x08
+#define P_X		0x10
+#define P_M		0x20
+#define P_V		0x40
+#define P_N		0x80
+
+struct machine
+{
+	unsigned char *data;
+	unsigned long len;
+	struct mapper *map;
+	unsigned char *wram;		// $7E0000-$7FFFFF
+	unsigned char io;			// next value read from an I/O register
+	unsigned short a,x,y,s,d,pc;
+	unsigned char dbr,pbr,p,e;
+};
+
+/* rd() - reads a byte as the CPU would see it
+ * Post: I/O registers read $00 and $FF in turn, so that loops waiting on
+ *       the hardware get out one way or the other. Anything unmapped
+ *       reads 0.
+ */
+
+static unsigned char rd(struct machine *m, unsigned long addr)
+{
+	unsigned long lo = addr & 0xFFFF;
+	long off;
+
+	if ((addr & 0xFE0000) == 0x7E0000)
+	{
+		return m->wram[addr & 0x1FFFF];
+	}
+	if (!(addr & 0x400000) && lo < 0x8000)
+	{
+		if (lo < 0x2000)
+		{
+			return m->wram[lo];
+		}
+		m->io ^= 0xFF;
+		return m->io;
+	}
+	off = snes2off(m->map, addr);
+	return (off >= 0 && (unsigned long)off < m->len) ? m->data[off] : 0;
+}
+
+/* wr() - writes a byte; only WRAM keeps it */
+
+static void wr(struct machine *m, unsigned long addr, unsigned char v)
+{
+	if ((addr & 0xFE0000) == 0x7E0000)
+	{
+		m->wram[addr & 0x1FFFF] = v;
+	}
+	else if (!(addr & 0x400000) && (addr & 0xFFFF) < 0x2000)
+	{
+		m->wram[addr & 0x1FFF] = v;
+	}
+}
+
+static unsigned long rd16(struct machine *m, unsigned long addr)
+{
+	return rd(m, addr) | (rd(m, (addr + 1) & 0xFFFFFF) << 8);
+}
+
+static unsigned long rd24(struct machine *m, unsigned long addr)
+{
+	return rd16(m, addr) | (rd(m, (addr + 2) & 0xFFFFFF) << 16);
+}
+
+/* Stack; emulation mode keeps it in page 1 */
+
+static void push8(struct machine *m, unsigned char v)
+{
+	wr(m, m->s, v);
+	m->s = m->e ? (0x100 | ((m->s - 1) & 0xFF)) : (m->s - 1);
+}
+
+static void push16(struct machine *m, unsigned short v)
+{
+	push8(m, v >> 8);
+	push8(m, v & 0xFF);
+}
+
+static unsigned char pull8(struct machine *m)
+{
+	m->s = m->e ? (0x100 | ((m->s + 1) & 0xFF)) : (m->s + 1);
+	return rd(m, m->s);
+}
+
+static unsigned short pull16(struct machine *m)
+{
+	unsigned short lo = pull8(m);
+
+	return lo | (pull8(m) << 8);
+}
+
+/* setp() - sets P, applying what the M/X/E flags imply for the registers */
+
+static void setp(struct machine *m, unsigned char p)
+{
+	m->p = m->e ? (p | P_M | P_X) : p;
+	if (m->p & P_X)
+	{
+		m->x &= 0xFF;
+		m->y &= 0xFF;
+	}
+	if (m->e)
+	{
+		m->s = 0x100 | (m->s & 0xFF);
+	}
+}
+
+/* nz() - sets N and Z for a result of the given width */
+
+static void nz(struct machine *m, unsigned long v, int wide)
+{
+	m->p &= ~(P_N | P_Z);
+	if (wide)
+	{
+		m->p |= ((v & 0xFFFF) == 0 ? P_Z : 0) | ((v & 0x8000) ? P_N : 0);
+	}
+	else
+	{
+		m->p |= ((v & 0xFF) == 0 ? P_Z : 0) | ((v & 0x80) ? P_N : 0);
+	}
+}
+
+/* ea() - works out the address a memory operand refers to
+ * Pre:  o - the operand bytes, as a little-endian number
+ */
+
+static unsigned long ea(struct machine *m, int mode, unsigned long o)
+{
+	unsigned long db = (unsigned long)m->dbr << 16;
+
+	switch (mode)
+	{
+	case AM_DP:
+		return (m->d + o) & 0xFFFF;
+	case AM_DPX:
+		return (m->d + o + m->x) & 0xFFFF;
+	case AM_DPY:
+		return (m->d + o + m->y) & 0xFFFF;
+	case AM_DPIND:
+		return db | rd16(m, (m->d + o) & 0xFFFF);
+	case AM_DPINDL:
+		return rd24(m, (m->d + o) & 0xFFFF);
+	case AM_DPINDX:
+		return db | rd16(m, (m->d + o + m->x) & 0xFFFF);
+	case AM_DPINDY:
+		return ((db | rd16(m, (m->d + o) & 0xFFFF)) + m->y) & 0xFFFFFF;
+	case AM_DPINDLY:
+		return (rd24(m, (m->d + o) & 0xFFFF) + m->y) & 0xFFFFFF;
+	case AM_SR:
+		return (m->s + o) & 0xFFFF;
+	case AM_SRINDY:
+		return ((db | rd16(m, (m->s + o) & 0xFFFF)) + m->y) & 0xFFFFFF;
+	case AM_ABSX:
+		return ((db | o) + m->x) & 0xFFFFFF;
+	case AM_ABSY:
+		return ((db | o) + m->y) & 0xFFFFFF;
+	case AM_LONG:
+		return o;
+	case AM_LONGX:
+		return (o + m->x) & 0xFFFFFF;
+	}
+	return db | o;
+}
+
+/* load() - fetches an operand's value, immediate or from memory */
+
+static unsigned long load(struct machine *m, int mode, unsigned long o, int wide)
+{
+	unsigned long addr;
+
+	switch (mode)
+	{
+	case AM_IMM8:
+	case AM_IMMM:
+	case AM_IMMX:
+		return o;
+	case AM_ACC:
+		return wide ? m->a : (m->a & 0xFF);
+	}
+	addr = ea(m, mode, o);
+	return wide ? rd16(m, addr) : rd(m, addr);
+}
+
+/* store() - writes a value to an operand (A for the accumulator forms) */
+
+static void store(struct machine *m, int mode, unsigned long o, unsigned long v, int wide)
+{
+	unsigned long addr;
+
+	if (mode == AM_ACC)
+	{
+		m->a = wide ? (v & 0xFFFF) : ((m->a & 0xFF00) | (v & 0xFF));
+		return;
+	}
+	addr = ea(m, mode, o);
+	wr(m, addr, v & 0xFF);
+	if (wide)
+	{
+		wr(m, (addr + 1) & 0xFFFFFF, (v >> 8) & 0xFF);
+	}
+}
+
+/* setreg() - writes A, X or Y at the current width and sets N/Z */
+
+static void setreg(struct machine *m, unsigned short *reg, unsigned long v, int wide)
+{
+	*reg = wide ? (v & 0xFFFF) : ((reg == &m->a) ? ((m->a & 0xFF00) | (v & 0xFF)) : (v & 0xFF));
+	nz(m, v, wide);
+}
+
+/* compare() - CMP/CPX/CPY */
+
+static void compare(struct machine *m, unsigned long r, unsigned long v, int wide)
+{
+	unsigned long mask = wide ? 0xFFFF : 0xFF;
+
+	r &= mask;
+	m->p = (m->p & ~P_C) | (r >= v ? P_C : 0);
+	nz(m, r - v, wide);
+}
+
+/* adc() - binary add with carry (decimal mode isn't emulated) */
+
+static void adc(struct machine *m, unsigned long v, int wide)
+{
+	unsigned long mask = wide ? 0xFFFF : 0xFF, sign = wide ? 0x8000 : 0x80;
+	unsigned long a = m->a & mask, r;
+
+	r = a + v + (m->p & P_C);
+	m->p &= ~(P_C | P_V);
+	m->p |= (r > mask ? P_C : 0) | ((~(a ^ v) & (a ^ r) & sign) ? P_V : 0);
+	setreg(m, &m->a, r, wide);
+}
+
+/* shift() - ASL/LSR/ROL/ROR on a value
+ * Pre:  kind - opcode bits 5-7: 0 ASL, 1 ROL, 2 LSR, 3 ROR
+ */
+
+static unsigned long shift(struct machine *m, int kind, unsigned long v, int wide)
+{
+	unsigned long sign = wide ? 0x8000 : 0x80, mask = wide ? 0xFFFF : 0xFF, c = m->p & P_C;
+
+	m->p &= ~P_C;
+	if (kind < 2)
+	{
+		m->p |= (v & sign) ? P_C : 0;
+		v = ((v << 1) | (kind == 1 ? c : 0)) & mask;
+	}
+	else
+	{
+		m->p |= (v & 1) ? P_C : 0;
+		v = (v >> 1) | ((kind == 3 && c) ? sign : 0);
+	}
+	nz(m, v, wide);
+	return v;
+}
+
+/* interrupt() - BRK/COP: push the state and go through a vector
+ * Pre:  vec/evec - native and emulation mode vectors
+ */
+
+static void interrupt(struct machine *m, unsigned short vec, unsigned short evec)
+{
+	if (!m->e)
+	{
+		push8(m, m->pbr);
+	}
+	push16(m, m->pc);
+	push8(m, m->p);
+	m->p = (m->p | P_I) & ~P_D;
+	m->pbr = 0;
+	m->pc = rd16(m, m->e ? evec : vec);
+}
+
+/* step() - executes one instruction
+ * Post: returns 0, or 1 if the CPU stops (WAI, STP) or runs off into
+ *       I/O space.
+ */
+
+static int step(struct machine *m)
+{
+	unsigned long pcaddr = ((unsigned long)m->pbr << 16) | m->pc, o, v, addr;
+	unsigned char op = rd(m, pcaddr);
+	int mode = opmode[op], len = oplen[OPSTATE(m->p)][op], m16 = !(m->p & P_M), x16 = !(m->p & P_X);
+	int i;
+
+	// Operand bytes
+	for (i=1, o=0; i<len; i++)
+	{
+		o |= (unsigned long)rd(m, (pcaddr & 0xFF0000) | ((pcaddr + i) & 0xFFFF)) << ((i-1) * 8);
+	}
+	m->pc += len;
+
+	// ORA, AND, EOR, ADC, STA, LDA, CMP, SBC
+	if (op != 0x89 && ((op & 0x01) || (op & 0x1F) == 0x12) && mode != AM_IMP)
+	{
+		switch (op >> 5)
+		{
+		case 0:
+			setreg(m, &m->a, m->a | load(m, mode, o, m16), m16);
+			break;
+		case 1:
+			setreg(m, &m->a, m->a & load(m, mode, o, m16), m16);
+			break;
+		case 2:
+			setreg(m, &m->a, m->a ^ load(m, mode, o, m16), m16);
+			break;
+		case 3:
+			adc(m, load(m, mode, o, m16), m16);
+			break;
+		case 4:
+			store(m, mode, o, m->a, m16);
+			break;
+		case 5:
+			setreg(m, &m->a, load(m, mode, o, m16), m16);
+			break;
+		case 6:
+			compare(m, m->a, load(m, mode, o, m16), m16);
+			break;
+		case 7:
+			adc(m, ~load(m, mode, o, m16) & (m16 ? 0xFFFF : 0xFF), m16);
+			break;
+		}
+		return 0;
+	}
+
+	switch (op)
+	{
+		// ASL, ROL, LSR, ROR
+	case 0x06: case 0x0A: case 0x0E: case 0x16: case 0x1E:
+	case 0x26: case 0x2A: case 0x2E: case 0x36: case 0x3E:
+	case 0x46: case 0x4A: case 0x4E: case 0x56: case 0x5E:
+	case 0x66: case 0x6A: case 0x6E: case 0x76: case 0x7E:
+		store(m, mode, o, shift(m, op >> 5, load(m, mode, o, m16), m16), m16);
+		break;
+		// INC, DEC
+	case 0x1A: case 0xE6: case 0xEE: case 0xF6: case 0xFE:
+		v = load(m, mode, o, m16) + 1;
+		store(m, mode, o, v, m16);
+		nz(m, v, m16);
+		break;
+	case 0x3A: case 0xC6: case 0xCE: case 0xD6: case 0xDE:
+		v = load(m, mode, o, m16) - 1;
+		store(m, mode, o, v, m16);
+		nz(m, v, m16);
+		break;
+		// TSB, TRB
+	case 0x04: case 0x0C: case 0x14: case 0x1C:
+		v = load(m, mode, o, m16);
+		m->p = (m->p & ~P_Z) | (((v & m->a) & (m16 ? 0xFFFF : 0xFF)) == 0 ? P_Z : 0);
+		store(m, mode, o, (op & 0x10) ? (v & ~m->a) : (v | m->a), m16);
+		break;
+		// BIT
+	case 0x89:
+		m->p = (m->p & ~P_Z) | (((o & m->a) & (m16 ? 0xFFFF : 0xFF)) == 0 ? P_Z : 0);
+		break;
+	case 0x24: case 0x2C: case 0x34: case 0x3C:
+		v = load(m, mode, o, m16);
+		m->p = (m->p & ~(P_Z|P_N|P_V)) | (((v & m->a) & (m16 ? 0xFFFF : 0xFF)) == 0 ? P_Z : 0);
+		m->p |= (v >> (m16 ? 8 : 0)) & (P_N|P_V);
+		break;
+		// LDX, LDY, STX, STY, STZ, CPX, CPY
+	case 0xA2: case 0xA6: case 0xAE: case 0xB6: case 0xBE:
+		setreg(m, &m->x, load(m, mode, o, x16), x16);
+		break;
+	case 0xA0: case 0xA4: case 0xAC: case 0xB4: case 0xBC:
+		setreg(m, &m->y, load(m, mode, o, x16), x16);
+		break;
+	case 0x86: case 0x8E: case 0x96:
+		store(m, mode, o, m->x, x16);
+		break;
+	case 0x84: case 0x8C: case 0x94:
+		store(m, mode, o, m->y, x16);
+		break;
+	case 0x64: case 0x74: case 0x9C: case 0x9E:
+		store(m, mode, o, 0, m16);
+		break;
+	case 0xE0: case 0xE4: case 0xEC:
+		compare(m, m->x, load(m, mode, o, x16), x16);
+		break;
+	case 0xC0: case 0xC4: case 0xCC:
+		compare(m, m->y, load(m, mode, o, x16), x16);
+		break;
+		// INX, INY, DEX, DEY
+	case 0xE8:
+		setreg(m, &m->x, m->x + 1, x16);
+		break;
+	case 0xC8:
+		setreg(m, &m->y, m->y + 1, x16);
+		break;
+	case 0xCA:
+		setreg(m, &m->x, m->x - 1, x16);
+		break;
+	case 0x88:
+		setreg(m, &m->y, m->y - 1, x16);
+		break;
+		// Transfers
+	case 0xAA:
+		setreg(m, &m->x, m->a, x16);
+		break;
+	case 0xA8:
+		setreg(m, &m->y, m->a, x16);
+		break;
+	case 0x8A:
+		setreg(m, &m->a, m->x, m16);
+		break;
+	case 0x98:
+		setreg(m, &m->a, m->y, m16);
+		break;
+	case 0x9B:
+		setreg(m, &m->y, m->x, x16);
+		break;
+	case 0xBB:
+		setreg(m, &m->x, m->y, x16);
+		break;
+	case 0xBA:
+		setreg(m, &m->x, m->s, x16);
+		break;
+	case 0x9A:
+		m->s = m->e ? (0x100 | (m->x & 0xFF)) : m->x;
+		break;
+	case 0x1B:
+		m->s = m->e ? (0x100 | (m->a & 0xFF)) : m->a;
+		break;
+	case 0x3B:
+		setreg(m, &m->a, m->s, 1);
+		break;
+	case 0x5B:
+		m->d = m->a;
+		nz(m, m->d, 1);
+		break;
+	case 0x7B:
+		setreg(m, &m->a, m->d, 1);
+		break;
+	case 0xEB:
+		m->a = (m->a >> 8) | (m->a << 8);
+		nz(m, m->a, 0);
+		break;
+		// Flags
+	case 0x18: case 0x38: case 0x58: case 0x78: case 0xD8: case 0xF8:
+		v = (op & 0xC0) == 0x00 ? P_C : (op & 0xC0) == 0x40 ? P_I : P_D;
+		m->p = (op & 0x20) ? (m->p | v) : (m->p & ~v);
+		break;
+	case 0xB8:
+		m->p &= ~P_V;
+		break;
+	case 0xC2:
+		setp(m, m->p & ~o);
+		break;
+	case 0xE2:
+		setp(m, m->p | o);
+		break;
+	case 0xFB:
+		v = m->e;
+		m->e = m->p & P_C;
+		m->p = (m->p & ~P_C) | (v ? P_C : 0);
+		setp(m, m->p);
+		break;
+		// Stack
+	case 0x48:
+		if (m16)
+		{
+			push8(m, m->a >> 8);
+		}
+		push8(m, m->a & 0xFF);
+		break;
+	case 0xDA:
+	case 0x5A:
+		v = (op == 0xDA) ? m->x : m->y;
+		if (x16)
+		{
+			push8(m, v >> 8);
+		}
+		push8(m, v & 0xFF);
+		break;
+	case 0x08:
+		push8(m, m->p);
+		break;
+	case 0x8B:
+		push8(m, m->dbr);
+		break;
+	case 0x0B:
+		push16(m, m->d);
+		break;
+	case 0x4B:
+		push8(m, m->pbr);
+		break;
+	case 0xF4:
+		push16(m, o);
+		break;
+	case 0xD4:
+		push16(m, rd16(m, (m->d + o) & 0xFFFF));
+		break;
+	case 0x62:
+		push16(m, m->pc + o);
+		break;
+	case 0x68:
+		setreg(m, &m->a, m16 ? pull16(m) : pull8(m), m16);
+		break;
+	case 0xFA:
+		setreg(m, &m->x, x16 ? pull16(m) : pull8(m), x16);
+		break;
+	case 0x7A:
+		setreg(m, &m->y, x16 ? pull16(m) : pull8(m), x16);
+		break;
+	case 0x28:
+		setp(m, pull8(m));
+		break;
+	case 0xAB:
+		m->dbr = pull8(m);
+		nz(m, m->dbr, 0);
+		break;
+	case 0x2B:
+		m->d = pull16(m);
+		nz(m, m->d, 1);
+		break;
+		// Branches
+	case 0x10: case 0x30: case 0x50: case 0x70: case 0x90: case 0xB0: case 0xD0: case 0xF0:
+		// Bits 6-7 pick N, V, C or Z, bit 5 the state to branch on
+		v = (op >> 6) == 0 ? P_N : (op >> 6) == 1 ? P_V : (op >> 6) == 2 ? P_C : P_Z;
+		if (((m->p & v) != 0) == ((op & 0x20) != 0))
+		{
+			m->pc += (signed char)o;
+		}
+		break;
+	case 0x80:
+		m->pc += (signed char)o;
+		break;
+	case 0x82:
+		m->pc += (short)o;
+		break;
+		// Jumps and calls
+	case 0x4C:
+		m->pc = o;
+		break;
+	case 0x5C:
+		m->pc = o & 0xFFFF;
+		m->pbr = o >> 16;
+		break;
+	case 0x6C:
+		m->pc = rd16(m, o);
+		break;
+	case 0x7C:
+		m->pc = rd16(m, ((unsigned long)m->pbr << 16) | ((o + m->x) & 0xFFFF));
+		break;
+	case 0xDC:
+		addr = rd24(m, o);
+		m->pc = addr & 0xFFFF;
+		m->pbr = addr >> 16;
+		break;
+	case 0x20:
+		push16(m, m->pc - 1);
+		m->pc = o;
+		break;
+	case 0xFC:
+		push16(m, m->pc - 1);
+		m->pc = rd16(m, ((unsigned long)m->pbr << 16) | ((o + m->x) & 0xFFFF));
+		break;
+	case 0x22:
+		push8(m, m->pbr);
+		push16(m, m->pc - 1);
+		m->pc = o & 0xFFFF;
+		m->pbr = o >> 16;
+		break;
+	case 0x60:
+		m->pc = pull16(m) + 1;
+		break;
+	case 0x6B:
+		m->pc = pull16(m) + 1;
+		m->pbr = pull8(m);
+		break;
+	case 0x40:
+		setp(m, pull8(m));
+		m->pc = pull16(m);
+		if (!m->e)
+		{
+			m->pbr = pull8(m);
+		}
+		break;
+	case 0x00:
+		interrupt(m, 0xFFE6, 0xFFFE);
+		break;
+	case 0x02:
+		interrupt(m, 0xFFE4, 0xFFF4);
+		break;
+		// MVN/MVP run the whole move at once
+	case 0x44:
+	case 0x54:
+		m->dbr = o & 0xFF;
+		do
+		{
+			wr(m, (o << 16 & 0xFF0000) | m->y, rd(m, ((o << 8) & 0xFF0000) | m->x));
+			v = (op == 0x54) ? 1 : -1;
+			m->x = (m->x + v) & (x16 ? 0xFFFF : 0xFF);
+			m->y = (m->y + v) & (x16 ? 0xFFFF : 0xFF);
+		} while (m->a-- != 0);
+		break;
+		// WAI, STP
+	case 0xCB:
+	case 0xDB:
+		return 1;
+	}
+	return 0;
+}
+
+/* execute() - runs the code from each entry point
+ * Pre:  an     - analysis from trace()
+ *       entry  - entry points, as for trace(); each one starts on a fresh
+ *                machine with cleared registers and WRAM
+ *       steps  - most instructions to run from each entry point
+ * Post: run    - the code reached that isn't in an->cmap yet, as entry
+ *                points for trace() with the flags it ran with
+ *                (free() run->found when done), plus the number of steps
+ *                run and of instructions that ran at other widths than
+ *                the trace gave them.
+ */
+
+void execute(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct entry *entry, int nentry, unsigned long steps, struct execrun *run)
+{
+	struct machine m;
+	unsigned char *seen;
+	unsigned long n,addr;
+	long off;
+	int i,size=0;
+
+	memset(run, 0, sizeof(struct execrun));
+	memset(&m, 0, sizeof(m));
+	m.data = data;
+	m.len = len;
+	m.map = map;
+	if ((m.wram = malloc(0x20000)) == NULL || (seen = calloc((len + 7) / 8, 1)) == NULL)
+	{
+		printf("Cant alloc execution state.\n");
+		exit(1);
+	}
+
+	for (i=0; i<nentry; i++)
+	{
+		memset(m.wram, 0, 0x20000);
+		m.a = m.x = m.y = m.d = 0;
+		m.dbr = 0;
+		m.pbr = entry[i].addr >> 16;
+		m.pc = entry[i].addr & 0xFFFF;
+		m.e = (entry[i].flag & FLAG_E) != 0;
+		m.s = 0x1FF;
+		setp(&m, (entry[i].flag & 0xFF) | P_I);
+
+		for (n=0; n<steps; n++)
+		{
+			addr = ((unsigned long)m.pbr << 16) | m.pc;
+			off = snes2off(map, addr);
+			if (off < 0 || (unsigned long)off >= len)
+			{
+				// Code copied to WRAM runs, but nothing else outside the ROM
+				if ((addr & 0xFE0000) != 0x7E0000 && ((addr & 0x400000) || (addr & 0xFFFF) >= 0x2000))
+				{
+					break;
+				}
+			}
+			else if (!(seen[off >> 3] & (1 << (off & 7))))
+			{
+				seen[off >> 3] |= 1 << (off & 7);
+				if (!(an->cmap[off] & CM_OP))
+				{
+					if (run->nfound == size)
+					{
+						size = size ? size * 2 : 256;
+						if ((run->found = realloc(run->found, size * sizeof(struct entry))) == NULL)
+						{
+							printf("Cant alloc execution results.\n");
+							exit(1);
+						}
+					}
+					run->found[run->nfound].addr = addr;
+					run->found[run->nfound].flag = m.p | (m.e ? FLAG_E : 0);
+					// D/DBR may only be what they were on this one path
+					run->found[run->nfound].ctx = 0;
+					run->nfound++;
+				}
+				else if ((an->cmap[off] & 0x30) != (m.p & 0x30))
+				{
+					run->conflicts++;
+				}
+			}
+			if (step(&m))
+			{
+				n++;
+				break;
+			}
+		}
+		run->steps += n;
+	}
+
+	free(seen);
+	free(m.wram);
+}
@@ -0,0 +1,206 @@
+/* find.c
+ * Pattern search module for DisPel
+ * Finds instruction sequences in the image without listing it. Patterns
+ * are compiled once into a set of possible opcodes per instruction, so
+ * most offsets are turned away on their first byte; only the survivors
+ * are decoded and their operands compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "dispel.h"
+
+/* glob() - matches text against a pattern, ignoring case
+ * Pre:  pat - '?' matches any one character, '*' any run of them
+ * Post: returns 1 if the whole of text matches.
+ */
+
+static int glob(const char *pat, const char *text)
+{
+	for (; *pat; pat++, text++)
+	{
+		if (*pat == '*')
+		{
+			do
+			{
+				if (glob(pat+1, text))
+				{
+					return 1;
+				}
+			} while (*text++);
+			return 0;
+		}
+		if (*text == 0 || (*pat != '?' && toupper((unsigned char)*pat) != toupper((unsigned char)*text)))
+		{
+			return 0;
+		}
+	}
+	return *text == 0;
+}
+
+/* compilepat() - compiles a search pattern
+ * Pre:  text - instructions separated by ';', each a mnemonic and operand
+ *              as listed ("sta $420B"), or "*" for any instruction.
+ *              '?' matches any one character and '*' any run, so "st?"
+ *              is any store and "#*" an immediate of either width.
+ * Post: pat  - the compiled pattern
+ *       returns 0, or -1 if the pattern is empty, too long, or names no
+ *       instruction.
+ */
+
+int compilepat(const char *text, struct pattern *pat)
+{
+	struct patelem *el;
+	char buf[64],mnem[16],*p;
+	int n,op;
+
+	pat->n = 0;
+	while (*text)
+	{
+		n = strcspn(text, ";");
+		if (pat->n == PATMAX || n >= (int)sizeof(buf))
+		{
+			return -1;
+		}
+		memcpy(buf, text, n);
+		buf[n] = 0;
+		text += n + (text[n] == ';');
+
+		el = &pat->elem[pat->n++];
+		memset(el->ops, 0, sizeof(el->ops));
+		strcpy(el->operand, "*");
+		if (sscanf(buf, "%15s", mnem) < 1)
+		{
+			return -1;
+		}
+
+		// The operand is the rest of the line, trimmed
+		p = strstr(buf, mnem) + strlen(mnem);
+		if (strcmp(mnem, "*") != 0)
+		{
+			p += strspn(p, " \t");
+			for (n=strlen(p); n>0 && isspace((unsigned char)p[n-1]); n--);
+			if (n >= (int)sizeof(el->operand))
+			{
+				return -1;
+			}
+			memcpy(el->operand, p, n);
+			el->operand[n] = 0;
+		}
+
+		// Long calls and jumps go by either name
+		for (op=0; op<256; op++)
+		{
+			if (glob(mnem, mnemonic(op, 0)) || glob(mnem, mnemonic(op, 4)))
+			{
+				el->ops[op >> 3] |= 1 << (op & 7);
+			}
+		}
+		for (op=0; op<32 && el->ops[op]==0; op++);
+		if (op == 32)
+		{
+			return -1;
+		}
+	}
+	return (pat->n > 0) ? 0 : -1;
+}
+
+/* matchat() - tries a pattern at one offset
+ * Pre:  off  - file offset of the first instruction
+ *       end  - last file offset the match may use
+ *       flag - processor state at off; ignored for traced code, which
+ *              uses the state it was traced with
+ * Post: text - the matched instructions, separated by "; "
+ *       returns 1 if the pattern matches there.
+ */
+
+static int matchat(struct listing *ls, struct pattern *pat, unsigned long off, unsigned long end,
+	unsigned short flag, char *text)
+{
+	unsigned char *cmap = (ls->an != NULL) ? ls->an->cmap : NULL;
+	char inst[64],*operand;
+	int e,offset,n;
+
+	text[0] = 0;
+	for (e=0; e<pat->n; e++)
+	{
+		if (off > end || off >= ls->len || !(pat->elem[e].ops[ls->data[off] >> 3] & (1 << (ls->data[off] & 7))))
+		{
+			return 0;
+		}
+		if (cmap != NULL)
+		{
+			if (!(cmap[off] & CM_OP))
+			{
+				return 0;
+			}
+			flag = (cmap[off] & 0x30) | ((cmap[off] & CM_EMU) ? FLAG_E : 0);
+		}
+
+		offset = disasm(ls->data+off, ls->len-off, off2snes(ls->map, off), &flag, inst, 1);
+		if (offset == 0 || off + offset > end + 1)
+		{
+			return 0;
+		}
+
+		// Compare the operand, without the padding after it
+		operand = strchr(inst, ' ') + 1;
+		for (n=strlen(operand); n>0 && operand[n-1]==' '; n--);
+		operand[n] = 0;
+		if (!glob(pat->elem[e].operand, operand))
+		{
+			return 0;
+		}
+
+		sprintf(text + strlen(text), "%s%s", e ? "; " : "", inst);
+		off += offset;
+	}
+	return 1;
+}
+
+/* search() - lists the matches of a pattern in one code region
+ * Pre:  ls  - output options; with a trace (ls->an), only traced
+ *             instructions at their traced widths can match
+ *       rg  - the region, start/end as file offsets
+ *       pat - pattern from compilepat()
+ * Post: each match is output as its address and instructions, and the
+ *       number of matches is returned. Untraced bytes are tried at
+ *       every offset and in all four A/X/Y size combinations, with
+ *       REP/SEP in the pattern followed.
+ */
+
+unsigned long search(struct listing *ls, struct region *rg, struct pattern *pat)
+{
+	unsigned long off,end,pos,found = 0;
+	unsigned short flag;
+	char text[PATMAX * 64];
+
+	end = (rg->end < ls->len) ? rg->end : ls->len - 1;
+	for (off=rg->start; off<=end && off<ls->len; off++)
+	{
+		// Most offsets fail on the first opcode, before anything's decoded
+		if (!(pat->elem[0].ops[ls->data[off] >> 3] & (1 << (ls->data[off] & 7))))
+		{
+			continue;
+		}
+		for (flag=0; flag<=0x30; flag+=0x10)
+		{
+			if (matchat(ls, pat, off, end, flag, text))
+			{
+				pos = (rg->origin < 0x1000000) ? rg->origin + (off - rg->start) : off2snes(ls->map, off);
+				fprintf(ls->fout, "%02lX/%04lX:\t%s\n", (pos >> 16) & 0xFF, pos & 0xFFFF, text);
+				found++;
+				break;
+			}
+			// Traced code only has the one state
+			if (ls->an != NULL)
+			{
+				break;
+			}
+		}
+	}
+	return found;
+}
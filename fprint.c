@@ -0,0 +1,336 @@
+/* fprint.c
+ * Routine fingerprinting module for DisPel
+ * Recognises library routines - compiler runtimes, sound drivers,
+ * decompressors - that games share. A routine's fingerprint is a hash of
+ * the opcodes it starts with, operands left out, so it's the same
+ * wherever the routine was linked. Fingerprints are taken from named code
+ * regions and looked up at every traced entry point.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Most and fewest instructions in a fingerprint
+#define FPLEN		16
+#define FPMIN		6
+// Hash multiplier
+#define FPMUL		0x01000193U
+
+// One known routine
+struct sig
+{
+	unsigned int hash;
+	int n;					// instructions hashed
+	char name[32];
+};
+
+// Known routines, from loadsigs(), in an open-addressed hash table
+static struct sig *sigs = NULL;
+static unsigned long nsig = 0, sigsize = 0;
+
+/* ends() - does an instruction end the straight-line code? */
+
+static int ends(unsigned char op)
+{
+	switch (op)
+	{
+	case 0x40:	// RTI
+	case 0x60:	// RTS
+	case 0x6B:	// RTL
+	case 0x4C:	// JMP
+	case 0x5C:	// JML
+	case 0x6C:
+	case 0x7C:
+	case 0xDC:
+	case 0x80:	// BRA
+	case 0x82:	// BRL
+	case 0xDB:	// STP
+		return 1;
+	}
+	return 0;
+}
+
+/* oplength() - length of a traced instruction, at its traced widths */
+
+static int oplength(unsigned char *cmap, unsigned char *data, unsigned long off)
+{
+	return oplen[OPSTATE(cmap[off])][data[off]];
+}
+
+/* fingerprint() - hashes the traced code at a file offset
+ * Pre:  off - start of a traced instruction
+ * Post: n   - instructions hashed: up to FPLEN, stopping after a return
+ *             or jump, or where the traced code stops
+ *       returns the hash.
+ */
+
+static unsigned int fingerprint(struct analysis *an, unsigned char *data, unsigned long len,
+	unsigned long off, int *n)
+{
+	unsigned int h = 0;
+
+	for (*n=0; *n<FPLEN && off<len && (an->cmap[off] & CM_OP); )
+	{
+		h = h * FPMUL + data[off] + 1;
+		(*n)++;
+		if (ends(data[off]))
+		{
+			break;
+		}
+		off += oplength(an->cmap, data, off);
+	}
+	return h;
+}
+
+/* findsig() - the table slot for a fingerprint: its entry, or where it'd go */
+
+static struct sig *findsig(unsigned int hash, int n)
+{
+	unsigned long i;
+
+	for (i=hash & (sigsize-1); sigs[i].n != 0; i=(i+1) & (sigsize-1))
+	{
+		if (sigs[i].hash == hash && sigs[i].n == n)
+		{
+			break;
+		}
+	}
+	return &sigs[i];
+}
+
+/* loadsigs() - loads a fingerprint file
+ * Pre:  file - lines of the form "<hash> <count> <name>", as written by
+ *              savesigs(). '#' starts a comment.
+ * Post: returns the number of fingerprints loaded, or -1 if the file
+ *       couldn't be read. Where two names share a fingerprint, the first
+ *       is kept.
+ */
+
+int loadsigs(const char *file)
+{
+	FILE *f;
+	char line[256],name[32];
+	unsigned int hash;
+	struct sig *s;
+	int n;
+
+	if ((f = fopen(file, "r")) == NULL)
+	{
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		line[strcspn(line, "#")] = 0;
+		if (sscanf(line, "%X %d %31s", &hash, &n, name) < 3 || n < FPMIN || n > FPLEN)
+		{
+			continue;
+		}
+
+		// Keep the table under half full
+		if ((nsig + 1) * 2 > sigsize)
+		{
+			struct sig *old = sigs;
+			unsigned long i,oldsize = sigsize;
+
+			sigsize = sigsize ? sigsize * 2 : 1024;
+			if ((sigs = calloc(sigsize, sizeof(struct sig))) == NULL)
+			{
+				printf("Cant alloc fingerprint table.\n");
+				exit(1);
+			}
+			for (i=0; i<oldsize; i++)
+			{
+				if (old[i].n != 0)
+				{
+					*findsig(old[i].hash, old[i].n) = old[i];
+				}
+			}
+			free(old);
+		}
+
+		s = findsig(hash, n);
+		if (s->n == 0)
+		{
+			s->hash = hash;
+			s->n = n;
+			strcpy(s->name, name);
+			nsig++;
+		}
+	}
+	fclose(f);
+	return nsig;
+}
+
+void freesigs(void)
+{
+	free(sigs);
+	sigs = NULL;
+	nsig = sigsize = 0;
+}
+
+/* savesigs() - adds the fingerprints of named code regions to a file
+ * Pre:  an     - the trace
+ *       region - regions of the image, with file offsets
+ * Post: returns the number of fingerprints appended, or -1 if the file
+ *       couldn't be written. Regions too short to tell apart, or not
+ *       traced, are skipped.
+ */
+
+int savesigs(struct analysis *an, unsigned char *data, unsigned long len, struct region *region, int nregion,
+	const char *file)
+{
+	FILE *f;
+	unsigned int hash;
+	int r,n,count=0;
+
+	if ((f = fopen(file, "a")) == NULL)
+	{
+		return -1;
+	}
+	for (r=0; r<nregion; r++)
+	{
+		if (region[r].type != RT_CODE || !region[r].name[0] || region[r].start >= len)
+		{
+			continue;
+		}
+		hash = fingerprint(an, data, len, region[r].start, &n);
+		if (n >= FPMIN)
+		{
+			fprintf(f, "%08X %d %s\n", hash, n, region[r].name);
+			count++;
+		}
+	}
+	fclose(f);
+	return count;
+}
+
+/* namesigs() - finds the known routines in the traced code
+ * Pre:  an     - the trace
+ *       region - regions of the image, with file offsets, sorted
+ * Post: list   - a named RT_CODE region for each traced entry point in a
+ *                code region whose fingerprint is known, running up to
+ *                the next one or the end of the code region, in file
+ *                offset order. Entry points the region file already
+ *                names are left alone, and names found more than once
+ *                get the address added.
+ *       returns the number of regions.
+ *       The instructions are hashed in one pass, keeping the running
+ *       hash after each; the hash of any run of them then comes from two
+ *       of those, so each entry point costs one table lookup.
+ */
+
+int namesigs(struct analysis *an, unsigned char *data, unsigned long len, struct mapper *map,
+	struct region *region, int nregion, struct region **list)
+{
+	unsigned long *offs,off,m=0,t,e;
+	unsigned int *run,pw[FPLEN+1];
+	unsigned long *stop;
+	struct region *out;
+	struct sig *s;
+	int i,n,r=0,count=0;
+
+	*list = NULL;
+	if (nsig == 0)
+	{
+		return 0;
+	}
+
+	for (off=0; off<len; off++)
+	{
+		m += (an->cmap[off] & CM_OP) != 0;
+	}
+	// Working space from the analysis's arena; the regions are the caller's
+	offs = aalloc(&an->arena, (m + 1) * sizeof(unsigned long));
+	stop = aalloc(&an->arena, (m + 1) * sizeof(unsigned long));
+	run = aalloc(&an->arena, (m + 1) * sizeof(unsigned int));
+	if ((out = malloc((m + 1) * sizeof(struct region))) == NULL)
+	{
+		printf("Cant alloc fingerprint scan.\n");
+		exit(1);
+	}
+
+	pw[0] = 1;
+	for (i=1; i<=FPLEN; i++)
+	{
+		pw[i] = pw[i-1] * FPMUL;
+	}
+
+	// Running hash of every traced instruction, in order
+	run[0] = 0;
+	for (off=0, t=0; off<len; off++)
+	{
+		if (an->cmap[off] & CM_OP)
+		{
+			offs[t] = off;
+			run[t+1] = run[t] * FPMUL + data[off] + 1;
+			t++;
+		}
+	}
+
+	// Where the straight-line code from each instruction ends
+	for (t=m; t-- > 0; )
+	{
+		if (ends(data[offs[t]]) || t + 1 == m || offs[t] + oplength(an->cmap, data, offs[t]) != offs[t+1])
+		{
+			stop[t] = t + 1;
+		}
+		else
+		{
+			stop[t] = stop[t+1];
+		}
+	}
+
+	for (t=0; t<m; t++)
+	{
+		if (!(an->cmap[offs[t]] & CM_TARGET))
+		{
+			continue;
+		}
+		while (r < nregion && region[r].end < offs[t])
+		{
+			r++;
+		}
+		if (r == nregion || region[r].start > offs[t] || region[r].type != RT_CODE ||
+			(region[r].start == offs[t] && region[r].name[0]))
+		{
+			continue;
+		}
+		e = (stop[t] < t + FPLEN) ? stop[t] : t + FPLEN;
+		n = e - t;
+		if (n < FPMIN)
+		{
+			continue;
+		}
+		s = findsig(run[e] - run[t] * pw[n], n);
+		if (s->n == 0)
+		{
+			continue;
+		}
+
+		out[count].start = offs[t];
+		out[count].end = region[r].end;
+		out[count].type = RT_CODE;
+		out[count].flag = (an->cmap[offs[t]] & 0x30) | ((an->cmap[offs[t]] & CM_EMU) ? FLAG_E : 0);
+		out[count].origin = 0x1000000;
+		strcpy(out[count].name, s->name);
+		for (i=0; i<count; i++)
+		{
+			if (strcmp(out[i].name, s->name) == 0)
+			{
+				sprintf(out[count].name, "%.23s_%06lX", s->name, off2snes(map, offs[t]) & 0xFFFFFF);
+				break;
+			}
+		}
+		if (count > 0 && out[count-1].end >= offs[t])
+		{
+			out[count-1].end = offs[t] - 1;
+		}
+		count++;
+	}
+
+	*list = out;
+	return count;
+}
@@ -0,0 +1,239 @@
+/* gsu.c
+ * SuperFX (GSU) module for DisPel
+ * Disassembles code for the SuperFX coprocessor. ALT1/ALT2/ALT3 and WITH
+ * are prefixes that change the instruction after them, so they're kept
+ * in the processor state from one instruction to the next.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Processor state: prefix flags, and the WITH register in bits 8-11
+#define GSU_ALT1	0x01
+#define GSU_ALT2	0x02
+#define GSU_B		0x04	// after WITH
+
+// Opcodes $00-$0F
+static const char *lowops[16] =
+{
+	"stop", "nop", "cache", "lsr", "rol", "bra", "bge", "blt",
+	"bne", "beq", "bpl", "bmi", "bcc", "bcs", "bvc", "bvs"
+};
+
+// Opcodes $3C-$3F and $4C-$4F
+static const char *ops3c[4] = { "loop", "alt1", "alt2", "alt3" };
+static const char *ops4c[4] = { "plot", "swap", "color", "not" };
+
+// GETB and GETC ($EF, $DF) by ALT state
+static const char *getbops[4] = { "getb", "getbh", "getbl", "getbs" };
+static const char *getcops[4] = { "getc", "getc", "ramb", "romb" };
+
+/* Register/immediate operations $5x-$8x and $Cx, by ALT state. ALT2 and
+ * ALT3 take #n rather than Rn, except for CMP.
+ */
+
+static const char *aluops[5][4] =
+{
+	{ "add", "adc", "add", "adc" },
+	{ "sub", "sbc", "sub", "cmp" },
+	{ "and", "bic", "and", "bic" },
+	{ "mult", "umult", "mult", "umult" },
+	{ "or", "xor", "or", "xor" }
+};
+
+/* gsulength() - length of an instruction, which doesn't depend on the state */
+
+static int gsulength(unsigned char op)
+{
+	if ((op >= 0x05 && op <= 0x0F) || (op & 0xF0) == 0xA0)
+	{
+		return 2;
+	}
+	return ((op & 0xF0) == 0xF0) ? 3 : 1;
+}
+
+/* gsustep() - tracks the prefixes across one instruction
+ * Post: flag - state after the instruction at mem
+ */
+
+static void gsustep(unsigned char *mem, unsigned short *flag)
+{
+	switch (mem[0])
+	{
+	case 0x3D:
+		*flag |= GSU_ALT1;
+		break;
+	case 0x3E:
+		*flag |= GSU_ALT2;
+		break;
+	case 0x3F:
+		*flag |= GSU_ALT1 | GSU_ALT2;
+		break;
+	default:
+		if ((mem[0] & 0xF0) == 0x20)
+		{
+			*flag = (*flag & (GSU_ALT1|GSU_ALT2)) | GSU_B | ((mem[0] & 0x0F) << 8);
+		}
+		// TO/FROM are prefixes too, except as MOVE/MOVES after WITH
+		else if (((mem[0] & 0xF0) != 0x10 && (mem[0] & 0xF0) != 0xB0) || (*flag & GSU_B))
+		{
+			*flag = 0;
+		}
+	}
+}
+
+unsigned long gsuscan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks)
+{
+	while (rpos < end)
+	{
+		if (marks != NULL)
+		{
+			marks[rpos] |= CM_OP;
+		}
+		gsustep(data+rpos, flag);
+		rpos += gsulength(data[rpos]);
+	}
+	return rpos;
+}
+
+/* gsudisasm() - disassembles a single SuperFX instruction
+ * Pre:  flag  - prefix state, from the instructions before (0 at the start)
+ *       otherwise as for disasm(), see fmtline()
+ * Post: flag  - prefix state after the instruction
+ *       inst  - disassembled instruction
+ *       returns number of bytes to advance, or 0 if truncated (see disasm()).
+ */
+
+int gsudisasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc)
+{
+	char pbuf[24];
+	const char *name;
+	unsigned char op;
+	int n, alt = *flag & (GSU_ALT1|GSU_ALT2), with = (*flag >> 8) & 0x0F, offset,sval;
+
+	if (avail == 0 || (unsigned long)(offset = gsulength(mem[0])) > avail)
+	{
+		return 0;
+	}
+	op = mem[0];
+	n = op & 0x0F;
+	pbuf[0] = 0;
+
+	switch (op >> 4)
+	{
+	case 0x0:
+		name = lowops[op];
+		if (op < 0x05)
+		{
+			break;
+		}
+		sval = (mem[1]>127) ? (mem[1]-256) : mem[1];
+		sprintf(pbuf, "$%04lX", (pos+sval+2) & 0xFFFF);
+		break;
+	case 0x1:
+		name = (*flag & GSU_B) ? "move" : "to";
+		sprintf(pbuf, (*flag & GSU_B) ? "R%d,R%d" : "R%d", n, with);
+		break;
+	case 0x2:
+		name = "with";
+		sprintf(pbuf, "R%d", n);
+		break;
+	case 0x3:
+	case 0x4:
+		if (n < 12)
+		{
+			name = (op & 0x40) ? ((alt == GSU_ALT1) ? "ldb" : "ldw") : ((alt == GSU_ALT1) ? "stb" : "stw");
+			sprintf(pbuf, "(R%d)", n);
+		}
+		else if (op & 0x40)
+		{
+			name = (alt == GSU_ALT1 && n == 12) ? "rpix" : (alt == GSU_ALT1 && n == 14) ? "cmode" : ops4c[n - 12];
+		}
+		else
+		{
+			name = ops3c[n - 12];
+		}
+		break;
+	case 0x9:
+		switch (n)
+		{
+		case 0x0:
+			name = "sbk";
+			break;
+		case 0x1:
+		case 0x2:
+		case 0x3:
+		case 0x4:
+			name = "link";
+			sprintf(pbuf, "#%d", n);
+			break;
+		case 0x5:
+			name = "sex";
+			break;
+		case 0x6:
+			name = (alt == GSU_ALT1) ? "div2" : "asr";
+			break;
+		case 0x7:
+			name = "ror";
+			break;
+		case 0xE:
+			name = "lob";
+			break;
+		case 0xF:
+			name = (alt == GSU_ALT1) ? "lmult" : "fmult";
+			break;
+		default:
+			name = (alt == GSU_ALT1) ? "ljmp" : "jmp";
+			sprintf(pbuf, "R%d", n);
+		}
+		break;
+	case 0xA:
+		// The short RAM addresses count in words
+		name = (alt == GSU_ALT1) ? "lms" : (alt == GSU_ALT2) ? "sms" : "ibt";
+		sprintf(pbuf, (alt == GSU_ALT1) ? "R%d,($%04X)" : (alt == GSU_ALT2) ? "($%04X),R%d" : "R%d,#$%02X",
+			(alt == GSU_ALT2) ? mem[1] * 2 : n, (alt == GSU_ALT1) ? mem[1] * 2 : (alt == GSU_ALT2) ? n : mem[1]);
+		break;
+	case 0xB:
+		name = (*flag & GSU_B) ? "moves" : "from";
+		sprintf(pbuf, (*flag & GSU_B) ? "R%d,R%d" : "R%d", (*flag & GSU_B) ? with : n, n);
+		break;
+	case 0xD:
+	case 0xE:
+		if (n < 15)
+		{
+			name = (op & 0x20) ? "dec" : "inc";
+			sprintf(pbuf, "R%d", n);
+		}
+		else if (op & 0x20)
+		{
+			name = getbops[alt];
+		}
+		else
+		{
+			name = getcops[alt];
+		}
+		break;
+	case 0xF:
+		name = (alt == GSU_ALT1) ? "lm" : (alt == GSU_ALT2) ? "sm" : "iwt";
+		sprintf(pbuf, (alt == GSU_ALT1) ? "R%d,($%04X)" : (alt == GSU_ALT2) ? "($%04X),R%d" : "R%d,#$%04X",
+			(alt == GSU_ALT2) ? mem[1] + mem[2]*256 : n, (alt == GSU_ALT2) ? n : mem[1] + mem[2]*256);
+		break;
+	default:
+		if (op == 0x70 || op == 0xC0)
+		{
+			name = (op == 0x70) ? "merge" : "hib";
+			break;
+		}
+		name = aluops[((op >> 4) == 0xC) ? 4 : (op >> 4) - 5][alt];
+		sprintf(pbuf, ((alt & GSU_ALT2) && !((op >> 4) == 0x6 && alt == (GSU_ALT1|GSU_ALT2))) ? "#%d" : "R%d", n);
+	}
+
+	gsustep(mem, flag);
+	fmtline(mem, pos, offset, name, pbuf, inst, tsrc);
+	return offset;
+}
@@ -0,0 +1,689 @@
+/* gzip.c
+ * Compression module for DisPel
+ * Writes the listing gzip-compressed, and reads gzip-compressed images.
+ * Output goes through an ordinary FILE, so nothing else needs to know;
+ * the stream compresses whatever is written to it with LZ77 and the
+ * fixed Huffman codes, which suits listings well enough without having
+ * to buffer up blocks to build trees for.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+#define WSIZE		32768		// LZ77 window
+#define HBITS		15
+#define HSIZE		(1 << HBITS)
+#define MINMATCH	3
+#define MAXMATCH	258
+#define CHAIN		32			// most earlier matches tried at each byte
+#define ZOUT		16384
+
+// Deflate length and distance codes: base values and extra bits
+static const unsigned short lbase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char lextra[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short dbase[30] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char dextra[30] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static unsigned long crctab[256];
+
+/* crc32() - updates a gzip CRC over some bytes */
+
+static unsigned long crc32(unsigned long crc, const unsigned char *p, unsigned long n)
+{
+	unsigned long c;
+	int i,k;
+
+	if (crctab[1] == 0)
+	{
+		for (i=0; i<256; i++)
+		{
+			for (c=i, k=0; k<8; k++)
+			{
+				c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+			}
+			crctab[i] = c;
+		}
+	}
+	crc ^= 0xFFFFFFFFUL;
+	while (n--)
+	{
+		crc = crctab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return crc ^ 0xFFFFFFFFUL;
+}
+
+// Compressing stream behind a FILE
+struct zstream
+{
+	FILE *f;
+	unsigned char win[2 * WSIZE];	// history, then bytes still to encode
+	long fill;						// bytes in win
+	long pos;						// next byte to encode
+	long head[HSIZE];				// latest position of each hash, or -1
+	long prev[WSIZE];				// position before it with the same hash
+	unsigned long bits;				// bits not yet output, LSB first
+	int nbits;
+	unsigned char out[ZOUT];
+	int nout;
+	unsigned long crc,size;
+	int err;
+};
+
+/* putbits() - outputs bits, LSB first, as deflate packs them */
+
+static void putbits(struct zstream *z, unsigned long v, int n)
+{
+	z->bits |= v << z->nbits;
+	z->nbits += n;
+	while (z->nbits >= 8)
+	{
+		z->out[z->nout++] = z->bits & 0xFF;
+		z->bits >>= 8;
+		z->nbits -= 8;
+		if (z->nout == ZOUT)
+		{
+			z->err |= fwrite(z->out, ZOUT, 1, z->f) != 1;
+			z->nout = 0;
+		}
+	}
+}
+
+/* putcode() - outputs a Huffman code, which goes MSB first */
+
+static void putcode(struct zstream *z, unsigned int code, int n)
+{
+	unsigned int rev = 0;
+	int i;
+
+	for (i=0; i<n; i++)
+	{
+		rev = (rev << 1) | ((code >> i) & 1);
+	}
+	putbits(z, rev, n);
+}
+
+/* putsym() - outputs a literal/length symbol in the fixed code */
+
+static void putsym(struct zstream *z, int sym)
+{
+	if (sym < 144)
+	{
+		putcode(z, 0x30 + sym, 8);
+	}
+	else if (sym < 256)
+	{
+		putcode(z, 0x190 + sym - 144, 9);
+	}
+	else if (sym < 280)
+	{
+		putcode(z, sym - 256, 7);
+	}
+	else
+	{
+		putcode(z, 0xC0 + sym - 280, 8);
+	}
+}
+
+/* putmatch() - outputs a length/distance pair */
+
+static void putmatch(struct zstream *z, int len, int dist)
+{
+	int c;
+
+	for (c=28; lbase[c] > len; c--);
+	putsym(z, 257 + c);
+	putbits(z, len - lbase[c], lextra[c]);
+	for (c=29; dbase[c] > dist; c--);
+	putcode(z, c, 5);
+	putbits(z, dist - dbase[c], dextra[c]);
+}
+
+static unsigned int hash3(const unsigned char *p)
+{
+	return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HSIZE - 1);
+}
+
+/* insert() - adds the string at a position to the hash chains */
+
+static void insert(struct zstream *z, long p)
+{
+	unsigned int h;
+
+	if (p + MINMATCH <= z->fill)
+	{
+		h = hash3(z->win + p);
+		z->prev[p & (WSIZE-1)] = z->head[h];
+		z->head[h] = p;
+	}
+}
+
+/* encode() - compresses the buffered bytes
+ * Pre:  final - 1 to encode everything; otherwise the last MAXMATCH
+ *               bytes are kept back, as later writes could extend a match
+ */
+
+static void encode(struct zstream *z, int final)
+{
+	long cand,best,bestdist,limit,n;
+	int chain;
+
+	while (z->pos < z->fill && (final || z->fill - z->pos > MAXMATCH))
+	{
+		best = 0;
+		bestdist = 0;
+		limit = (z->fill - z->pos < MAXMATCH) ? z->fill - z->pos : MAXMATCH;
+		if (limit >= MINMATCH)
+		{
+			cand = z->head[hash3(z->win + z->pos)];
+			for (chain=0; cand >= 0 && z->pos - cand <= WSIZE && chain < CHAIN; chain++)
+			{
+				if (z->win[cand + best] == z->win[z->pos + best])
+				{
+					for (n=0; n<limit && z->win[cand+n] == z->win[z->pos+n]; n++);
+					if (n > best)
+					{
+						best = n;
+						bestdist = z->pos - cand;
+						if (n == limit)
+						{
+							break;
+						}
+					}
+				}
+				cand = z->prev[cand & (WSIZE-1)];
+			}
+		}
+
+		if (best >= MINMATCH)
+		{
+			putmatch(z, best, bestdist);
+		}
+		else
+		{
+			putsym(z, z->win[z->pos]);
+			best = 1;
+		}
+		while (best--)
+		{
+			insert(z, z->pos++);
+		}
+	}
+}
+
+/* slide() - drops the oldest half of the window to make room */
+
+static void slide(struct zstream *z)
+{
+	long i;
+
+	memmove(z->win, z->win + WSIZE, WSIZE);
+	z->fill -= WSIZE;
+	z->pos -= WSIZE;
+	for (i=0; i<HSIZE; i++)
+	{
+		z->head[i] = (z->head[i] >= WSIZE) ? z->head[i] - WSIZE : -1;
+	}
+	for (i=0; i<WSIZE; i++)
+	{
+		z->prev[i] = (z->prev[i] >= WSIZE) ? z->prev[i] - WSIZE : -1;
+	}
+}
+
+static long zwrite(void *cookie, const char *buf, long size)
+{
+	struct zstream *z = cookie;
+	long n,done = 0;
+
+	z->crc = crc32(z->crc, (const unsigned char *)buf, size);
+	z->size += size;
+	while (done < size)
+	{
+		if (z->fill == 2 * WSIZE)
+		{
+			encode(z, 0);
+			slide(z);
+		}
+		n = 2 * WSIZE - z->fill;
+		n = (n > size - done) ? size - done : n;
+		memcpy(z->win + z->fill, buf + done, n);
+		z->fill += n;
+		done += n;
+	}
+	return z->err ? -1 : size;
+}
+
+static int zclose(void *cookie)
+{
+	struct zstream *z = cookie;
+	unsigned char trailer[8];
+	int err,i;
+
+	encode(z, 1);
+	putsym(z, 256);
+	// An empty final block ends the stream
+	putbits(z, 3, 3);
+	putsym(z, 256);
+	putbits(z, 0, 7);
+
+	for (i=0; i<4; i++)
+	{
+		trailer[i] = (z->crc >> (i * 8)) & 0xFF;
+		trailer[i+4] = (z->size >> (i * 8)) & 0xFF;
+	}
+	err = z->err || (z->nout && fwrite(z->out, z->nout, 1, z->f) != 1) || fwrite(trailer, 8, 1, z->f) != 1;
+	err |= fclose(z->f) != 0;
+	free(z);
+	return err ? -1 : 0;
+}
+
+#if defined(__GLIBC__)
+static ssize_t cookiewrite(void *cookie, const char *buf, size_t size)
+{
+	return zwrite(cookie, buf, size);
+}
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+static int cookiewrite(void *cookie, const char *buf, int size)
+{
+	return zwrite(cookie, buf, size);
+}
+#endif
+
+/* zopen() - opens a file for gzip-compressed output
+ * Post: returns a stream that compresses what's written to it, or NULL
+ *       if the file can't be created. The gzip trailer is written when
+ *       the stream is closed. Where the C library can't put a FILE over
+ *       our own functions (Windows), this always fails.
+ */
+
+FILE *zopen(const char *file)
+{
+	static const unsigned char header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+	struct zstream *z;
+	FILE *f;
+	long i;
+
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+	if ((f = fopen(file, "wb")) == NULL)
+	{
+		return NULL;
+	}
+	if ((z = calloc(1, sizeof(struct zstream))) == NULL)
+	{
+		printf("Cant alloc compressor.\n");
+		exit(1);
+	}
+	z->f = f;
+	for (i=0; i<HSIZE; i++)
+	{
+		z->head[i] = -1;
+	}
+	fwrite(header, 10, 1, f);
+	// One fixed-code block holds everything
+	putbits(z, 2, 3);
+
+#if defined(__GLIBC__)
+	{
+		cookie_io_functions_t io = { NULL, cookiewrite, NULL, zclose };
+
+		f = fopencookie(z, "w", io);
+	}
+#else
+	f = funopen(z, NULL, cookiewrite, NULL, zclose);
+#endif
+	if (f == NULL)
+	{
+		zclose(z);
+	}
+	return f;
+#else
+	return NULL;
+#endif
+}
+
+// Bit reader for inflate()
+struct zin
+{
+	const unsigned char *in;
+	unsigned long len,at;
+	unsigned long bits;
+	int nbits;
+	unsigned char *out;
+	unsigned long outlen,done;
+};
+
+// Canonical Huffman code: symbol counts per length, then symbols in order
+struct huff
+{
+	short count[16];
+	short sym[320];
+};
+
+static int getbits(struct zin *s, int n)
+{
+	long v;
+
+	while (s->nbits < n)
+	{
+		if (s->at >= s->len)
+		{
+			return -1;
+		}
+		s->bits |= (unsigned long)s->in[s->at++] << s->nbits;
+		s->nbits += 8;
+	}
+	v = s->bits & ((1UL << n) - 1);
+	s->bits >>= n;
+	s->nbits -= n;
+	return v;
+}
+
+/* mkhuff() - builds a decoding table from code lengths
+ * Post: returns 0, or -1 if the lengths oversubscribe the code
+ */
+
+static int mkhuff(struct huff *h, const unsigned char *lens, int n)
+{
+	short offs[16];
+	int i,left = 1;
+
+	memset(h->count, 0, sizeof(h->count));
+	for (i=0; i<n; i++)
+	{
+		h->count[lens[i]]++;
+	}
+	for (i=1; i<16; i++)
+	{
+		left = (left << 1) - h->count[i];
+		if (left < 0)
+		{
+			return -1;
+		}
+	}
+	offs[1] = 0;
+	for (i=1; i<15; i++)
+	{
+		offs[i+1] = offs[i] + h->count[i];
+	}
+	for (i=0; i<n; i++)
+	{
+		if (lens[i])
+		{
+			h->sym[offs[lens[i]]++] = i;
+		}
+	}
+	return 0;
+}
+
+/* decode() - reads one symbol, a bit at a time */
+
+static int decode(struct zin *s, struct huff *h)
+{
+	int code = 0,first = 0,index = 0,len,bit;
+
+	for (len=1; len<16; len++)
+	{
+		if ((bit = getbits(s, 1)) < 0)
+		{
+			return -1;
+		}
+		code |= bit;
+		if (code - first < h->count[len])
+		{
+			return h->sym[index + code - first];
+		}
+		index += h->count[len];
+		first = (first + h->count[len]) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+/* codes() - decodes one block's literals and matches */
+
+static int codes(struct zin *s, struct huff *lit, struct huff *dist)
+{
+	int sym,len,d;
+
+	for (;;)
+	{
+		if ((sym = decode(s, lit)) < 0)
+		{
+			return -1;
+		}
+		if (sym < 256)
+		{
+			if (s->done == s->outlen)
+			{
+				return -1;
+			}
+			s->out[s->done++] = sym;
+		}
+		else if (sym == 256)
+		{
+			return 0;
+		}
+		else
+		{
+			sym -= 257;
+			if (sym >= 29 || (len = getbits(s, lextra[sym])) < 0)
+			{
+				return -1;
+			}
+			len += lbase[sym];
+			if ((sym = decode(s, dist)) < 0 || sym >= 30 || (d = getbits(s, dextra[sym])) < 0)
+			{
+				return -1;
+			}
+			d += dbase[sym];
+			if ((unsigned long)d > s->done || s->done + len > s->outlen)
+			{
+				return -1;
+			}
+			for (; len>0; len--, s->done++)
+			{
+				s->out[s->done] = s->out[s->done - d];
+			}
+		}
+	}
+}
+
+/* dynamic() - reads the code lengths of a dynamic block */
+
+static int dynamic(struct zin *s, struct huff *lit, struct huff *dist)
+{
+	static const unsigned char order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+	unsigned char lens[320];
+	struct huff lencode;
+	int nlen,ndist,ncode,i,sym,rep,v;
+
+	nlen = getbits(s, 5) + 257;
+	ndist = getbits(s, 5) + 1;
+	ncode = getbits(s, 4) + 4;
+	if (nlen > 286 || ndist > 30 || ncode < 4)
+	{
+		return -1;
+	}
+	memset(lens, 0, sizeof(lens));
+	for (i=0; i<ncode; i++)
+	{
+		if ((v = getbits(s, 3)) < 0)
+		{
+			return -1;
+		}
+		lens[order[i]] = v;
+	}
+	if (mkhuff(&lencode, lens, 19) < 0)
+	{
+		return -1;
+	}
+
+	for (i=0; i<nlen+ndist; )
+	{
+		if ((sym = decode(s, &lencode)) < 0)
+		{
+			return -1;
+		}
+		if (sym < 16)
+		{
+			lens[i++] = sym;
+			continue;
+		}
+		v = 0;
+		if (sym == 16)
+		{
+			if (i == 0)
+			{
+				return -1;
+			}
+			v = lens[i-1];
+			rep = getbits(s, 2) + 3;
+		}
+		else
+		{
+			rep = (sym == 17) ? getbits(s, 3) + 3 : getbits(s, 7) + 11;
+		}
+		if (rep < 3 || i + rep > nlen + ndist)
+		{
+			return -1;
+		}
+		while (rep--)
+		{
+			lens[i++] = v;
+		}
+	}
+	if (mkhuff(lit, lens, nlen) < 0 || mkhuff(dist, lens + nlen, ndist) < 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/* gunzip() - decompresses a gzip image
+ * Pre:  in/inlen - the whole file
+ * Post: returns the decompressed bytes (with 3 zero bytes after them, as
+ *       the image buffer has), and their length in outlen; or NULL if
+ *       this isn't a gzip file or it's damaged.
+ */
+
+unsigned char *gunzip(const unsigned char *in, unsigned long inlen, unsigned long *outlen)
+{
+	unsigned char lens[320];
+	struct huff lit,dist;
+	struct zin s;
+	int last,type,i,err = 0;
+	unsigned long n;
+
+	if (inlen < 18 || in[0] != 0x1F || in[1] != 0x8B || in[2] != 8)
+	{
+		return NULL;
+	}
+	memset(&s, 0, sizeof(s));
+	s.in = in;
+	s.len = inlen - 8;
+	s.at = 10;
+	// Optional extra field, name, comment and header CRC
+	if (in[3] & 4)
+	{
+		s.at += 2 + in[10] + in[11] * 256;
+	}
+	for (i=3; i<=4; i++)
+	{
+		if (in[3] & (1 << i))
+		{
+			while (s.at < s.len && in[s.at++] != 0);
+		}
+	}
+	if (in[3] & 2)
+	{
+		s.at += 2;
+	}
+	// An extra field or CRC running past the data can't be right
+	if (s.at > s.len)
+	{
+		return NULL;
+	}
+
+	s.outlen = in[inlen-4] | (in[inlen-3] << 8) | (in[inlen-2] << 16) | ((unsigned long)in[inlen-1] << 24);
+	if ((s.out = malloc(s.outlen ? s.outlen : 1)) == NULL)
+	{
+		printf("Cant alloc %ld bytes.\n", s.outlen);
+		exit(1);
+	}
+
+	do
+	{
+		last = getbits(&s, 1);
+		type = getbits(&s, 2);
+		if (type == 0)
+		{
+			// Stored block, from the next byte boundary
+			s.bits = 0;
+			s.nbits = 0;
+			if (s.at + 4 > s.len)
+			{
+				err = 1;
+				break;
+			}
+			// LEN, then NLEN, its complement
+			n = in[s.at] | (in[s.at+1] << 8);
+			if ((in[s.at+2] | (in[s.at+3] << 8)) != (~n & 0xFFFF))
+			{
+				err = 1;
+				break;
+			}
+			s.at += 4;
+			if (s.at + n > s.len || s.done + n > s.outlen)
+			{
+				err = 1;
+				break;
+			}
+			memcpy(s.out + s.done, in + s.at, n);
+			s.at += n;
+			s.done += n;
+		}
+		else if (type == 1)
+		{
+			for (i=0; i<288; i++)
+			{
+				lens[i] = (i < 144) ? 8 : (i < 256) ? 9 : (i < 280) ? 7 : 8;
+			}
+			mkhuff(&lit, lens, 288);
+			memset(lens, 5, 30);
+			mkhuff(&dist, lens, 30);
+			err = codes(&s, &lit, &dist) < 0;
+		}
+		else
+		{
+			err = type != 2 || dynamic(&s, &lit, &dist) < 0 || codes(&s, &lit, &dist) < 0;
+		}
+	} while (!err && last == 0);
+
+	if (err || last < 0 || s.done != s.outlen || crc32(0, s.out, s.done) !=
+		(in[inlen-8] | (in[inlen-7] << 8) | (in[inlen-6] << 16) | ((unsigned long)in[inlen-5] << 24)))
+	{
+		free(s.out);
+		return NULL;
+	}
+	*outlen = s.done;
+	return s.out;
+}
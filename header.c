@@ -0,0 +1,247 @@
+/* header.c
+ * Header detection module for DisPel
+ * Scores every candidate header location, with and without a $200 byte
+ * copier header, and picks the memory map and header skip to use.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Copier headers are this size, and leave the image this far off a 32K multiple
+#define COPIER 0x200
+
+/* Snes9x Hi/LoROM autodetect code, extended with bounds checks and
+ * checksum verification */
+
+static int AllASCII(unsigned char *b, int size)
+{
+	int i;
+	for (i = 0; i < size; i++)
+	{
+		if (b[i] < 32 || b[i] > 126)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* sumblocks() - sums the image in COPIER sized blocks
+ * Pre:  data - file contents, len bytes
+ * Post: returns an array of per-block byte sums (the last block may be
+ *       partial), so that the sum of any block-aligned range is cheap.
+ */
+
+static unsigned long *sumblocks(unsigned char *data, unsigned long len, unsigned long *nblocks)
+{
+	unsigned long *sums,b,i,n;
+	unsigned int s;
+
+	*nblocks = (len + COPIER - 1) / COPIER;
+	if ((sums = malloc(*nblocks * sizeof(unsigned long) + 1)) == NULL)
+	{
+		printf("Cant alloc checksum blocks.\n");
+		exit(1);
+	}
+
+	// Fixed-size inner loop with a narrow accumulator, so it vectorizes
+	for (b=0; b<*nblocks; b++)
+	{
+		n = (len - b*COPIER < COPIER) ? len - b*COPIER : COPIER;
+		s = 0;
+		for (i=0; i<n; i++)
+		{
+			s += data[b*COPIER + i];
+		}
+		sums[b] = s;
+	}
+	return sums;
+}
+
+static unsigned long rangesum(unsigned long *sums, unsigned long from, unsigned long to)
+{
+	unsigned long s = 0;
+
+	for (from/=COPIER, to=(to + COPIER - 1)/COPIER; from<to; from++)
+	{
+		s += sums[from];
+	}
+	return s;
+}
+
+/* checksum() - computes the SNES checksum of an image
+ * Pre:  skip - offset of the image in the file, 0 or COPIER
+ *       len  - image length
+ * Post: returns the 16-bit checksum, with the part beyond the largest
+ *       power of two mirrored up to the next one, as the hardware sees it.
+ */
+
+static unsigned int checksum(unsigned long *sums, unsigned long skip, unsigned long len)
+{
+	unsigned long base,rest,s;
+
+	for (base=1; base*2 <= len; base*=2);
+	s = rangesum(sums, skip, skip + base);
+	rest = len - base;
+	if (rest)
+	{
+		s += rangesum(sums, skip + base, skip + len) * (base / rest);
+	}
+	return s & 0xFFFF;
+}
+
+/* scorehdr() - scores one candidate header
+ * Pre:  data - image
+ *       hdr  - offset of the candidate header ($xxFFC0 or $xx7FC0)
+ *       type - MAP_* type the location implies
+ *       sum  - checksum of the image
+ * Post: returns the score, higher is more likely.
+ */
+
+static int scorehdr(unsigned char *data, unsigned long hdr, int type, unsigned int sum)
+{
+	unsigned char *h = data + hdr;
+	int score = 0;
+
+	if ((h[0x1C] + h[0x1D]*256 + h[0x1E] + h[0x1F]*256) == 0xFFFF)
+	{
+		score += 2;
+		if (h[0x1E] + h[0x1F]*256 == sum)
+		{
+			score += 4;
+		}
+	}
+	if (h[0x1A] == 0x33)
+	{
+		score += 2;
+	}
+	if ((h[0x15] & 0xf) < 4)
+	{
+		score += 2;
+	}
+	// The map mode should agree with where the header is
+	if ((type == MAP_HIROM && (h[0x15] & 0xEF) == 0x21) ||
+		(type == MAP_LOROM && (h[0x15] & 0xEF) == 0x20) ||
+		(type == MAP_EXHIROM && (h[0x15] & 0xEF) == 0x25))
+	{
+		score += 2;
+	}
+	if (!(h[0x3D] & 0x80))
+	{
+		score -= 4;
+	}
+	if (h[0x17] < 7 || h[0x17] > 13 || (1 << (h[0x17] - 7)) > 48)
+	{
+		score -= 1;
+	}
+	if (!AllASCII(&h[-0x10], 6))
+	{
+		score -= 1;
+	}
+	if (!AllASCII(&h[0x00], 20))
+	{
+		score -= 1;
+	}
+	// Header space that's just fill is never a header
+	if (h[0x15] == h[0x16] && h[0x16] == h[0x17] && h[0x17] == h[0x3D])
+	{
+		score -= 8;
+	}
+
+	return score;
+}
+
+/* detect() - finds the header and memory map of an image
+ * Pre:  data    - whole file contents
+ *       len     - file length
+ *       skip    - COPIER or 0 to force the copier header skip, -1 to detect
+ *                 it (only for files $200 bytes over a 32K multiple)
+ *       mapping - MAP_* type to force, or -1 to detect
+ * Post: fills in hd with the best candidate. hd->header is -1 if the
+ *       file is too small to hold any header at all.
+ */
+
+void detect(unsigned char *data, unsigned long len, long skip, int mapping, struct romhead *hd)
+{
+	static const int types[] = { MAP_LOROM, MAP_HIROM, MAP_EXHIROM, MAP_EXLOROM };
+	unsigned long *sums,nblocks,ilen,hdr;
+	long s;
+	int t,type,score;
+	unsigned int sum;
+	unsigned char *h;
+
+	hd->mapping = (mapping < 0) ? MAP_LOROM : mapping;
+	hd->skip = (skip < 0 || (unsigned long)skip >= len) ? 0 : skip;
+	hd->score = -100;
+	hd->sumok = 0;
+	hd->header = -1;
+
+	sums = sumblocks(data, len, &nblocks);
+
+	for (s=0; s<=COPIER; s+=COPIER)
+	{
+		if ((skip >= 0 && s != skip) || (unsigned long)s >= len)
+		{
+			continue;
+		}
+		// Unforced, the skip is only tried when the file is $200 bytes off a
+		// 32K multiple, as a copier header leaves it
+		if (skip < 0 && s == COPIER && (len & 0x7FFF) != COPIER)
+		{
+			continue;
+		}
+		ilen = len - s;
+		sum = checksum(sums, s, ilen);
+
+		for (t=0; t<(int)(sizeof(types)/sizeof(types[0])); t++)
+		{
+			type = types[t];
+			// A forced mapper only looks in its own header location
+			if (mapping >= 0 && mapheader(type) != mapheader(mapping))
+			{
+				continue;
+			}
+			hdr = mapheader(type);
+			// The whole header, maker code to vectors, has to be in the image
+			if (hdr + 0x40 > ilen)
+			{
+				continue;
+			}
+
+			score = scorehdr(data + s, hdr, type, sum);
+			if ((len & 0x7FFF) == COPIER)
+			{
+				score += s ? 3 : -3;
+			}
+			if (score > hd->score)
+			{
+				hd->score = score;
+				hd->skip = s;
+				hd->mapping = (mapping >= 0) ? mapping : type;
+				hd->header = hdr;
+				h = data + s + hdr;
+				hd->sumok = (h[0x1E] + h[0x1F]*256 == sum) && (h[0x1C] + h[0x1D]*256 + h[0x1E] + h[0x1F]*256) == 0xFFFF;
+			}
+		}
+	}
+	free(sums);
+
+	if (mapping >= 0 || hd->header < 0)
+	{
+		return;
+	}
+
+	// Refine a LoROM-style header using the map mode and chipset
+	h = data + hd->skip + hd->header;
+	if ((h[0x15] & 0x0F) == 3)
+	{
+		hd->mapping = MAP_SA1;
+	}
+	else if (hd->mapping == MAP_LOROM && h[0x16] >= 0x13 && h[0x16] <= 0x1A)
+	{
+		hd->mapping = MAP_SUPERFX;
+	}
+}
@@ -0,0 +1,362 @@
+/* list.c
+ * Listing module for DisPel
+ * Outputs one region at a time - code, data or hexdump lines - so that
+ * the whole-image listing and the query mode share the same layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+static int hexdump(unsigned char *data,unsigned long pos,unsigned long rpos,
+			unsigned long len,char *inst, unsigned char dwidth)
+{
+	int i;
+
+	sprintf(inst, "%02lX/%04lX:\t", (pos >> 16) & 0xFF, pos & 0xFFFF);
+	for(i=0; i<dwidth && i+rpos<len; i++)
+	{
+		sprintf(inst + i*2 + 9, "%02X", data[rpos+i]);
+	}
+	return dwidth;
+}
+
+/* srcbytes() - outputs bytes as db lines of assembler source */
+
+static void srcbytes(FILE *fout, unsigned char *data, unsigned long pos, unsigned long n)
+{
+	char line[64];
+	int used;
+
+	while (n > 0)
+	{
+		used = fmtdata(data, pos, (n > 8) ? 8 : n, DF_BYTE, NOADDR, NULL, line, 5);
+		fprintf(fout, "\t%s\n", line);
+		data += used;
+		pos += used;
+		n -= used;
+	}
+}
+
+/* nextpos() - advances the listing address
+ * Pre:  pos    - listing address of the current file offset rpos
+ *       offset - number of bytes to advance
+ *       origin - user origin, or $1000000 if none
+ * Post: returns the listing address of rpos+offset. With a user origin
+ *       it just counts up; otherwise it's looked up whenever a 32K chunk
+ *       boundary is crossed.
+ */
+
+static unsigned long nextpos(struct mapper *map, unsigned long pos, unsigned long rpos, unsigned int offset,
+	unsigned long origin)
+{
+	if (origin < 0x1000000 || ((rpos & 0x7FFF) + offset) <= 0x7FFF)
+	{
+		return pos + offset;
+	}
+	return off2snes(map, rpos + offset);
+}
+
+/* addrlabel() - the label of the code or data at a file offset
+ * Post: name - the name of the region starting there, or for traced code
+ *              that's jumped to, L and its address
+ *       returns 1, or 0 if it has no label.
+ */
+
+int addrlabel(struct listing *ls, unsigned long off, char *name)
+{
+	int r;
+
+	for (r=0; r<ls->nregion; r++)
+	{
+		if (ls->region[r].start == off && ls->region[r].name[0])
+		{
+			strcpy(name, ls->region[r].name);
+			return 1;
+		}
+	}
+	if (ls->an != NULL && off < ls->len && (ls->an->cmap[off] & (CM_OP|CM_TARGET)) == (CM_OP|CM_TARGET))
+	{
+		sprintf(name, "L%06lX", off2snes(ls->map, off));
+		return 1;
+	}
+	return 0;
+}
+
+/* ptrlabel() - the label a line of pointer data points to
+ * Pre:  as for fmtdata()
+ * Post: returns name, or NULL for other formats or targets with no label.
+ */
+
+static const char *ptrlabel(struct listing *ls, unsigned char *mem, unsigned long pos, unsigned long n, int type,
+	unsigned long ptr, char *name)
+{
+	unsigned long target = ptrtarget(mem, pos, n, type, ptr);
+	long off;
+
+	if (target == NOADDR || (off = snes2off(ls->map, target)) < 0 || (unsigned long)off >= ls->len)
+	{
+		return NULL;
+	}
+	return addrlabel(ls, off, name) ? name : NULL;
+}
+
+/* costtext() - appends the cost of an instruction or block to a comment */
+
+static void costtext(char *inst, const char *sep, struct cost *c)
+{
+	inst += strlen(inst);
+	inst += sprintf(inst, (c->lo == c->hi) ? "%s%u" : "%s%u-%u", sep, c->lo, c->hi);
+	sprintf(inst, (c->clo == c->chi) ? " cyc, %lu clk" : " cyc, %lu-%lu clk", c->clo, c->chi);
+}
+
+/* listregion() - outputs one region
+ * Pre:  ls - output options, see struct listing
+ *       rg - the region, start/end as file offsets. Hex regions are
+ *            turned into db regions for assembler source.
+ * Post: the region is written to ls->fout, and ls->checked/differ
+ *       count the assembler source check. With ls->cycles, 65816 code
+ *       gets its cost, and the last instruction of each basic block the
+ *       block's.
+ */
+
+void listregion(struct listing *ls, struct region *rg)
+{
+	unsigned char abuf[ASMMAX],*data = ls->data;
+	unsigned char *cmap = (ls->an != NULL) ? ls->an->cmap : NULL;
+	unsigned char tsrc = ls->tsrc;
+	struct profile *pf = (tsrc & 4) ? NULL : ls->profile;
+	unsigned long len = ls->len,pos,origin,rpos,end,lim,next,ptr,i;
+	unsigned int offset,tmp;
+	unsigned short flag,state;
+	struct cost c,block;
+	unsigned long bstart = 0;
+	int inblock = 0;
+	const struct cpu *cpu;
+	FILE *fout = ls->fout;
+	char inst[521],line[600],name[40];
+	const char *body;
+	long ea;
+	int shown,fmt;
+
+	rpos = rg->start;
+	end = rg->end;
+	lim = (len < end+1) ? len : end+1;
+	origin = rg->origin;
+	pos = (origin < 0x1000000) ? origin : off2snes(ls->map, rpos);
+	cpu = cpufor(rg->type);
+	flag = (cpu != NULL) ? cpu->reset(rg->flag) : rg->flag;
+	if ((tsrc & 4) && rg->type == DF_HEX)
+	{
+		rg->type = DF_BYTE;
+	}
+	// A profile lays out the lines itself, from just the instructions
+	if (pf != NULL)
+	{
+		tsrc |= 1;
+	}
+
+	// Assembler source needs to say where each region goes
+	next = pos;
+	if ((tsrc & 4) && rpos < len && rpos <= end)
+	{
+		fprintf(fout, "\norg $%06lX\n", off2snes(ls->map, rpos));
+		if (origin < 0x1000000)
+		{
+			fprintf(fout, "base $%06lX\n", pos);
+		}
+	}
+	if (rg->name[0])
+	{
+		fprintf(fout, "%s:\n", rg->name);
+	}
+
+	while (rpos < len && rpos <= end)
+	{
+		// what follows the bytes in a profile line: nothing for hexdump
+		body = inst;
+		shown = 0;
+
+		// disassemble one instruction, or produce one line of hexdump
+		if (ls->dwidth != 0)
+		{
+			offset = hexdump(data, pos, rpos, len, inst, ls->dwidth);
+			shown = (len - rpos < offset) ? len - rpos : offset;
+			body = "";
+		}
+		else if (cpu == NULL)
+		{
+			// data regions go by line, never past the block, image or bank
+			offset = lim - rpos;
+			offset = (offset > 16) ? 16 : offset;
+			offset = (offset > 0x10000 - (pos & 0xFFFF)) ? 0x10000 - (pos & 0xFFFF) : offset;
+			if (rg->type == DF_HEX)
+			{
+				hexdump(data, pos, rpos, rpos+offset, inst, offset);
+				shown = offset;
+				body = "";
+			}
+			else
+			{
+				offset = fmtdata(data+rpos, pos, offset, rg->type, NOADDR,
+					ptrlabel(ls, data+rpos, pos, offset, rg->type, NOADDR, name), inst, tsrc);
+			}
+		}
+		else if (cmap != NULL && rg->type == RT_CODE && !(cmap[rpos] & CM_OP))
+		{
+			// untraced bytes up to the next instruction
+			offset = datarun(cmap, pos, rpos, len, end);
+			if (cmap[rpos] & CM_PTR)
+			{
+				ptr = ls->an->ctx[rpos] ? ls->an->ctx[rpos] : NOADDR;
+				offset = fmtdata(data+rpos, pos, offset, DF_PTR, ptr, ptrlabel(ls, data+rpos, pos, offset, DF_PTR, ptr, name),
+					inst, tsrc);
+			}
+			else if (ls->dformat != DF_HEX || (tsrc & 4))
+			{
+				fmt = (ls->dformat == DF_HEX) ? DF_BYTE : ls->dformat;
+				offset = fmtdata(data+rpos, pos, offset, fmt, NOADDR, ptrlabel(ls, data+rpos, pos, offset, fmt, NOADDR, name),
+					inst, tsrc);
+			}
+			else
+			{
+				hexdump(data, pos, rpos, rpos+offset, inst, offset);
+				shown = offset;
+				body = "";
+			}
+		}
+		else
+		{
+			if (cmap != NULL && rg->type == RT_CODE)
+			{
+				flag = (flag & ~(0x30|FLAG_E)) | (cmap[rpos] & 0x30) | ((cmap[rpos] & CM_EMU) ? FLAG_E : 0);
+			}
+			state = flag;
+			// Nothing past the block or the image is decoded; 0 if the instruction doesn't fit
+			offset = cpu->disasm(data+rpos, lim-rpos, pos, &flag, inst, tsrc);
+			shown = offset;
+
+			// Show where the operand really points, if D/DBR are known
+			ea = -1;
+			if (offset != 0 && cmap != NULL && rg->type == RT_CODE && (ea = effaddr(data+rpos, ls->an->ctx[rpos])) >= 0)
+			{
+				sprintf(inst + strlen(inst), "\t; $%06lX", ea);
+			}
+
+			if (offset != 0 && ls->cycles && rg->type == RT_CODE)
+			{
+				opcost(data+rpos, pos, state, (cmap != NULL) ? ls->an->ctx[rpos] : 0, ls->fast, &c);
+				costtext(inst, (ea >= 0) ? ", " : "\t; ", &c);
+				if (!inblock)
+				{
+					memset(&block, 0, sizeof(block));
+					bstart = pos;
+				}
+				block.lo += c.lo;
+				block.hi += c.hi;
+				block.clo += c.clo;
+				block.chi += c.chi;
+
+				// The block ends here, or where the next line isn't code or is jumped to
+				i = rpos + offset;
+				inblock = !(endsblock(data[rpos]) || i > end || i >= len ||
+					(cmap != NULL && (cmap[i] & (CM_OP|CM_TARGET)) != CM_OP));
+				if (!inblock)
+				{
+					sprintf(inst + strlen(inst), "; block $%06lX: ", bstart);
+					costtext(inst, "", &block);
+				}
+			}
+		}
+
+		// Assembler source picks up again wherever the address jumps
+		if ((tsrc & 4) && pos != next)
+		{
+			fprintf(fout, "\norg $%06lX\n", pos);
+		}
+
+		// Check for a file/block overrun
+		if (offset == 0 || (rpos + offset) > lim)
+		{
+			if (tsrc & 4)
+			{
+				srcbytes(fout, data+rpos, pos, lim - rpos);
+				break;
+			}
+
+			// print out remaining bytes and finish
+			if (pf != NULL)
+			{
+				emitline(pf, line, pos, data+rpos, lim - rpos, "");
+				fprintf(fout, "%s\n", line);
+				break;
+			}
+			fprintf(fout,"%02lX/%04lX:\t", (pos >> 16) & 0xFF, pos & 0xFFFF);
+			for (i=rpos; i<lim; i++)
+			{
+				fprintf(fout,"%02X", data[i]);
+			}
+			fprintf(fout,"\n");
+			break;
+		}
+
+		// Check for a bank overrun
+		if (ls->bound && ((pos & 0xFFFF) + offset) > 0x10000)
+		{
+			// print out remaining bytes
+			tmp = 0x10000 - (pos & 0xFFFF);
+			if (tsrc & 4)
+			{
+				srcbytes(fout, data+rpos, pos, tmp);
+			}
+			else if (pf != NULL)
+			{
+				emitline(pf, line, pos, data+rpos, tmp, "");
+				fprintf(fout, "%s\n", line);
+			}
+			else
+			{
+				fprintf(fout, "%02lX/%04lX:\t",(pos >> 16) & 0xFF, pos & 0xFFFF);
+				for (i=0; i<tmp; i++)
+				{
+					fprintf(fout, "%02X", data[rpos+i]);
+				}
+				fprintf(fout, "\n");
+			}
+			// Move to next bank
+			inblock = 0;
+			next = pos + tmp;
+			pos = nextpos(ls->map, pos, rpos, tmp, origin);
+			rpos += tmp;
+			continue;
+		}
+
+		if (tsrc & 4)
+		{
+			// Check the line assembles back to what it came from
+			if (assemble(inst, pos, abuf) != (int)offset || memcmp(abuf, data+rpos, offset) != 0)
+			{
+				fprintf(stderr, "Doesn't reassemble: $%06lX %s\n", pos, inst);
+				ls->differ++;
+			}
+			ls->checked += offset;
+			fprintf(fout, "\t%s\n", inst);
+		}
+		else if (pf != NULL)
+		{
+			emitline(pf, line, pos, data+rpos, shown, body);
+			fprintf(fout, "%s\n", line);
+		}
+		else
+		{
+			fprintf(fout, "%s\n", inst);
+		}
+		next = pos + offset;
+
+		// Move to next instruction
+		pos = nextpos(ls->map, pos, rpos, offset, origin);
+		rpos+=offset;
+	}
+}
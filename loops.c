@@ -0,0 +1,455 @@
+/* loops.c
+ * Hot loop module for DisPel
+ * Finds the loops in the traced code - a branch or jump back to code
+ * before it, and everything that can get from the loop's start round to
+ * that branch - and ranks them by what an iteration costs, or, given how
+ * many times each instruction ran, by what they cost in all.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// One control flow edge between traced instructions, by instruction index
+struct edge
+{
+	unsigned long from;
+	unsigned long to;
+};
+
+// One loop found
+struct loop
+{
+	unsigned long head;			// instruction index of the loop's start
+	unsigned long first, last;	// lowest and highest instruction in it
+	unsigned long n;			// instructions in it
+	struct cost iter;			// one time round
+	unsigned long runs;			// times the start ran, from the count file
+	unsigned long total;		// most clocks in all, from the count file
+	unsigned long rank;			// what it's ranked by
+};
+
+// Execution counts: file offset and count, sorted by offset
+struct count
+{
+	unsigned long off;
+	unsigned long n;
+};
+
+static struct count *counts = NULL;
+static unsigned long ncount = 0;
+
+static int countcmp(const void *a, const void *b)
+{
+	const struct count *ca = a, *cb = b;
+
+	return (ca->off > cb->off) - (ca->off < cb->off);
+}
+
+/* loadcounts() - loads an execution count file
+ * Pre:  file - lines of "<address> <count>": the hex address of an
+ *              instruction and the decimal number of times it ran. '#'
+ *              starts a comment.
+ * Post: returns the number of counts loaded, or -1 if the file couldn't
+ *       be read. Addresses not in the image are skipped.
+ */
+
+long loadcounts(const char *file, struct mapper *map, unsigned long len)
+{
+	FILE *f;
+	char line[256];
+	unsigned long addr,n,size = 0;
+	long off;
+
+	if ((f = fopen(file, "r")) == NULL)
+	{
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		line[strcspn(line, "#")] = 0;
+		if (sscanf(line, "%lX %lu", &addr, &n) < 2)
+		{
+			continue;
+		}
+		off = snes2off(map, addr & 0xFFFFFF);
+		if (off < 0 || (unsigned long)off >= len)
+		{
+			continue;
+		}
+		if (ncount == size)
+		{
+			size = size ? size * 2 : 1024;
+			if ((counts = realloc(counts, size * sizeof(struct count))) == NULL)
+			{
+				printf("Cant alloc execution counts.\n");
+				exit(1);
+			}
+		}
+		counts[ncount].off = off;
+		counts[ncount].n = n;
+		ncount++;
+	}
+	fclose(f);
+	qsort(counts, ncount, sizeof(struct count), countcmp);
+	return ncount;
+}
+
+void freecounts(void)
+{
+	free(counts);
+	counts = NULL;
+	ncount = 0;
+}
+
+/* runs() - times the instruction at a file offset ran, from the count file */
+
+static unsigned long runs(unsigned long off)
+{
+	unsigned long lo = 0, hi = ncount, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (counts[mid].off < off)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return (lo < ncount && counts[lo].off == off) ? counts[lo].n : 0;
+}
+
+/* opindex() - the instruction index of a file offset, or -1 if not traced */
+
+static long opindex(unsigned long *offs, unsigned long m, unsigned long off)
+{
+	unsigned long lo = 0, hi = m, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (offs[mid] < off)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return (lo < m && offs[lo] == off) ? (long)lo : -1;
+}
+
+/* jumpsto() - the file offset a branch or direct jump goes to
+ * Pre:  mem - the instruction
+ *       pc  - its address
+ * Post: returns the target, or -1 if it has none or it's not in the image.
+ *       fall is set to 1 if the next instruction can follow it.
+ */
+
+static long jumpsto(struct mapper *map, unsigned char *mem, unsigned long pc, int *fall)
+{
+	unsigned long bank = pc & 0xFF0000, operand = mem[1] | (mem[2] << 8);
+
+	*fall = 1;
+	switch (mem[0])
+	{
+	case 0x80:	// BRA
+		*fall = 0;
+		return snes2off(map, bank | ((pc + 2 + (signed char)mem[1]) & 0xFFFF));
+	case 0x82:	// BRL
+		*fall = 0;
+		return snes2off(map, bank | ((pc + 3 + (short)operand) & 0xFFFF));
+	case 0x4C:	// JMP
+		*fall = 0;
+		return snes2off(map, bank | operand);
+	case 0x5C:	// JML
+		*fall = 0;
+		return snes2off(map, operand | (mem[3] << 16));
+	case 0x00:	// BRK, COP, RTI, RTS, RTL, STP, indirect jumps
+	case 0x02:
+	case 0x40:
+	case 0x60:
+	case 0x6B:
+	case 0xDB:
+	case 0x6C:
+	case 0x7C:
+	case 0xDC:
+		*fall = 0;
+		return -1;
+	}
+	if (opmode[mem[0]] == AM_REL)
+	{
+		return snes2off(map, bank | ((pc + 2 + (signed char)mem[1]) & 0xFFFF));
+	}
+	return -1;
+}
+
+static int edgecmp(const void *a, const void *b)
+{
+	const struct edge *ea = a, *eb = b;
+
+	if (ea->to != eb->to)
+	{
+		return (ea->to > eb->to) - (ea->to < eb->to);
+	}
+	return (ea->from > eb->from) - (ea->from < eb->from);
+}
+
+static int loopcmp(const void *a, const void *b)
+{
+	const struct loop *la = a, *lb = b;
+
+	return (la->rank < lb->rank) - (la->rank > lb->rank);
+}
+
+/* into() - the first of the sorted edges into an instruction */
+
+static unsigned long into(struct edge *edge, unsigned long ne, unsigned long t)
+{
+	unsigned long lo = 0, hi = ne, mid;
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) / 2;
+		if (edge[mid].to < t)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* extend() - takes the ways round a loop on to the next instruction
+ * Pre:  path - cheapest and dearest cost from the loop's start to the
+ *              instruction before, and to the one after so far
+ *       c    - cost of the one after
+ */
+
+static void extend(struct cost *from, struct cost *path, struct cost *c)
+{
+	path->lo = (from->lo + c->lo < path->lo) ? from->lo + c->lo : path->lo;
+	path->hi = (from->hi + c->hi > path->hi) ? from->hi + c->hi : path->hi;
+	path->clo = (from->clo + c->clo < path->clo) ? from->clo + c->clo : path->clo;
+	path->chi = (from->chi + c->chi > path->chi) ? from->chi + c->chi : path->chi;
+}
+
+/* hotloops() - lists the most expensive loops in the traced code
+ * Pre:  ls  - the listing, with a trace
+ *       top - most loops to list
+ * Post: the loops are written to ls->fout, most expensive first, ranked
+ *       by the most clocks they took in all if execution counts are
+ *       loaded, or else by the most clocks one iteration takes.
+ *       returns the number of loops found.
+ *       A loop is a branch or jump back to a traced instruction at or
+ *       before it; its body is everything on a path from the loop's start
+ *       to that branch, and loops sharing a start are one loop. Code that
+ *       only jumps into the loop, and what comes before it, isn't body. An iteration's cost is the cheapest and
+ *       dearest path from the start to a branch back, not going round
+ *       any inner loop. Subroutines called aren't counted.
+ */
+
+unsigned long hotloops(struct listing *ls, unsigned long top)
+{
+	unsigned char *cmap = ls->an->cmap, *data = ls->data, *fall, mem[4];
+	unsigned long *offs,*stamp,*reach,*stack,m=0,ne=0,nback=0,nloop=0,mark=0,off,t,u,h,i,e,sp,len = ls->len;
+	long *targ,to;
+	struct edge *edge,*back;
+	struct cost *cost,*path,none;
+	struct loop *lp,*loop;
+	unsigned short flag;
+	unsigned long pos,stop;
+	int f;
+
+	for (off=0; off<len; off++)
+	{
+		m += (cmap[off] & CM_OP) != 0;
+	}
+	// Working space comes from the analysis's arena, and goes with it
+	offs = aalloc(&ls->an->arena, (m + 1) * sizeof(unsigned long));
+	stamp = aalloc(&ls->an->arena, (m + 1) * sizeof(unsigned long));
+	reach = aalloc(&ls->an->arena, (m + 1) * sizeof(unsigned long));
+	stack = aalloc(&ls->an->arena, (m + 1) * sizeof(unsigned long));
+	targ = aalloc(&ls->an->arena, (m + 1) * sizeof(long));
+	fall = aalloc(&ls->an->arena, m + 1);
+	cost = aalloc(&ls->an->arena, (m + 1) * sizeof(struct cost));
+	path = aalloc(&ls->an->arena, (m + 1) * sizeof(struct cost));
+	edge = aalloc(&ls->an->arena, (2 * m + 1) * sizeof(struct edge));
+	back = aalloc(&ls->an->arena, (m + 1) * sizeof(struct edge));
+	loop = aalloc(&ls->an->arena, (m + 1) * sizeof(struct loop));
+
+	// Every traced instruction, its cost and where it can go next
+	for (off=0, t=0; off<len; off++)
+	{
+		if (cmap[off] & CM_OP)
+		{
+			offs[t++] = off;
+		}
+	}
+	for (t=0; t<m; t++)
+	{
+		off = offs[t];
+		memset(mem, 0, 4);
+		memcpy(mem, data+off, (len-off) < 4 ? (len-off) : 4);
+		pos = off2snes(ls->map, off);
+		flag = (cmap[off] & 0x30) | ((cmap[off] & CM_EMU) ? FLAG_E : 0);
+		opcost(mem, pos, flag, ls->an->ctx[off], ls->fast, &cost[t]);
+
+		to = jumpsto(ls->map, mem, pos, &f);
+		targ[t] = (to >= 0) ? opindex(offs, m, to) : -1;
+		fall[t] = f && t + 1 < m && offs[t+1] == off + oplen[OPSTATE(cmap[off])][mem[0]];
+		if (targ[t] >= 0)
+		{
+			edge[ne].from = t;
+			edge[ne++].to = targ[t];
+			if ((unsigned long)targ[t] <= t)
+			{
+				back[nback].from = t;
+				back[nback++].to = targ[t];
+			}
+		}
+		if (fall[t])
+		{
+			edge[ne].from = t;
+			edge[ne++].to = t + 1;
+		}
+	}
+	qsort(edge, ne, sizeof(struct edge), edgecmp);
+	qsort(back, nback, sizeof(struct edge), edgecmp);
+
+	none.lo = 0;
+	none.hi = 0;
+	none.clo = 0;
+	none.chi = 0;
+	for (i=0; i<nback; i=u)
+	{
+		h = back[i].to;
+		lp = &loop[nloop];
+		lp->head = lp->first = lp->last = h;
+		lp->n = 0;
+
+		// The body: back up from each branch back to the start. Every start
+		// gets a fresh mark, even if its loop is dropped below.
+		mark++;
+		stamp[h] = mark;
+		for (u=i, sp=0; u<nback && back[u].to == h; u++)
+		{
+			if (stamp[back[u].from] != mark)
+			{
+				stamp[back[u].from] = mark;
+				stack[sp++] = back[u].from;
+			}
+		}
+		while (sp > 0)
+		{
+			t = stack[--sp];
+			for (e=into(edge, ne, t); e<ne && edge[e].to == t; e++)
+			{
+				if (stamp[edge[e].from] != mark)
+				{
+					stamp[edge[e].from] = mark;
+					stack[sp++] = edge[e].from;
+				}
+			}
+		}
+
+		// ...then forward from the start through what was found, which
+		// leaves out code that only gets there by jumping into the loop
+		reach[h] = mark;
+		stack[sp++] = h;
+		while (sp > 0)
+		{
+			t = stack[--sp];
+			lp->n++;
+			lp->first = (t < lp->first) ? t : lp->first;
+			lp->last = (t > lp->last) ? t : lp->last;
+			if (targ[t] >= 0 && stamp[targ[t]] == mark && reach[targ[t]] != mark)
+			{
+				reach[targ[t]] = mark;
+				stack[sp++] = targ[t];
+			}
+			if (fall[t] && stamp[t+1] == mark && reach[t+1] != mark)
+			{
+				reach[t+1] = mark;
+				stack[sp++] = t + 1;
+			}
+		}
+
+		// Cheapest and dearest way round: forward edges only, in order
+		for (t=h; t<=lp->last; t++)
+		{
+			path[t].lo = path[t].clo = ~0U;
+			path[t].hi = 0;
+			path[t].chi = 0;
+		}
+		path[h] = cost[h];
+		lp->iter.lo = lp->iter.clo = ~0U;
+		lp->iter.hi = 0;
+		lp->iter.chi = 0;
+		for (t=h; t<=lp->last; t++)
+		{
+			if (reach[t] != mark || path[t].hi == 0)
+			{
+				continue;
+			}
+			if (targ[t] >= 0 && (unsigned long)targ[t] == h)
+			{
+				extend(&path[t], &lp->iter, &none);
+			}
+			if (targ[t] > (long)t && reach[targ[t]] == mark)
+			{
+				extend(&path[t], &path[targ[t]], &cost[targ[t]]);
+			}
+			if (fall[t] && reach[t+1] == mark)
+			{
+				extend(&path[t], &path[t+1], &cost[t+1]);
+			}
+		}
+		if (lp->iter.hi == 0)
+		{
+			continue;
+		}
+
+		// What it cost in all, if we know how often it ran
+		lp->runs = runs(offs[h]);
+		lp->total = 0;
+		for (t=lp->first; ncount && t<=lp->last; t++)
+		{
+			if (reach[t] == mark)
+			{
+				lp->total += runs(offs[t]) * cost[t].chi;
+			}
+		}
+		lp->rank = ncount ? lp->total : lp->iter.chi;
+		nloop++;
+	}
+
+	qsort(loop, nloop, sizeof(struct loop), loopcmp);
+	for (i=0, stop=(top < nloop) ? top : nloop; i<stop; i++)
+	{
+		lp = &loop[i];
+		pos = off2snes(ls->map, offs[lp->head]);
+		fprintf(ls->fout, "%02lX/%04lX:\t$%06lX-$%06lX, %lu instructions, ", (pos >> 16) & 0xFF, pos & 0xFFFF,
+			off2snes(ls->map, offs[lp->first]), off2snes(ls->map, offs[lp->last]), lp->n);
+		fprintf(ls->fout, (lp->iter.lo == lp->iter.hi) ? "%u" : "%u-%u", lp->iter.lo, lp->iter.hi);
+		fprintf(ls->fout, (lp->iter.clo == lp->iter.chi) ? " cyc, %lu clk" : " cyc, %lu-%lu clk",
+			lp->iter.clo, lp->iter.chi);
+		if (ncount)
+		{
+			fprintf(ls->fout, " a time round; ran %lu times, up to %lu clk in all", lp->runs, lp->total);
+		}
+		fprintf(ls->fout, "\n");
+	}
+
+	return nloop;
+}
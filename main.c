@@ -21,139 +21,152 @@ void usage(void)
 {
 	printf("\nDisPel v1 by James Churchill/pelrun (C)2001-2011\n"
 		"65816/SNES Disassembler\n"
-		"Usage: dispel [-n] [-t] [-h] [-l] [-s] [-i] [-a] [-x] [-e] [-p]\n"
-		"              [-b <bank>|-r <startaddr>-<endaddr>] [-g <origin>]\n"
-		"              [-d <width>] [-o <outfile>] <infile>\n\n"
+		"Usage: dispel [-n] [-t] [-h] [-l] [-s] [-i] [-a] [-x] [-E] [-e] [-p] [-S] [-c] [-U] [-Q] [-z] [-V] [-K]\n"
+		"              [-m <mapper>] [-b <bank>[,...]] [-r <start>-<end>[,...]]\n"
+		"              [-g <origin>] [-d <width>] [-o <outfile>] [-M <mapfile>] [-X <steps>]\n"
+		"              [-C <cdlfile>] [-D <format>] [-T <tblfile>]\n"
+		"              [-R <regionfile>] [-A <srcfile>] [-P <cpu>] [-F <pattern>]\n"
+		"              [-L <sigfile>] [-W <sigfile>] [-O <profile>]\n"
+		"              [-H <count>] [-N <countfile>] <infile>\n"
+		"       dispel -G <romfile>\n\n"
 		"Options: (numbers are hex-only, no prefixes)\n"
-		" -n                Skip $200 byte SMC header\n"
+		" -n                Force skipping a $200 byte SMC header (normally detected)\n"
 		" -t                Don't output addresses/hex dump.\n"
 		" -h/-l             Force HiROM/LoROM memory mapping.\n"
+		" -m <mapper>       Force memory mapping: lorom, hirom, exhirom, exlorom,\n"
+		"                     sa1 or superfx.\n"
 		" -s/-i             Force enable/disable shadow ROM addresses (see readme.)\n"
 		" -a                Start in 8-bit accumulator mode. Default is 16-bit.\n"
 		" -x                Start in 8-bit X/Y mode. Default is 16-bit.\n"
+		" -E                Start in emulation mode (forces 8-bit A and X/Y).\n"
 		" -e                Turn off bank-boundary enforcement. (see readme.)\n"
 		" -p                Split subroutines by placing blank lines after RTS,RTL,RTI\n"
-		" -b <bank>         Disassemble bank <bank> only. Overrides -r.\n"
+		" -S                Output assembler source (asar syntax) and check that it\n"
+		"                     assembles back to the image.\n"
+		" -A <srcfile>      Assemble a patch into the image and write it to -o.\n"
+		" -G <romfile>      Write a test ROM holding every opcode (no <infile>.)\n"
+		" -c                Trace code from the vectors (and -r starts), following\n"
+		"                     jump tables. Untraced bytes are output as hex.\n"
+		" -b <bank>         Disassemble bank <bank>. Several can be given, separated\n"
+		"                     by commas, e.g. 80,81,C3.\n"
 		" -r <start>-<end>  Disassemble block from <start> to <end>.\n"
-		"                     Omit -<end> to disassemble to end of file.\n"
+		"                     Omit -<end> to disassemble to end of file. Several\n"
+		"                     can be given, separated by commas. (see readme.)\n"
 		" -g <origin>       Set origin of disassembled code (see readme.)\n"
 		" -d <width>        No disassembly - produce a hexdump with <width> bytes/line.\n"
 		" -o <outfile>      Set file to redirect output to. Default is stdout.\n"
-		" <infile>          File to disassemble.\n");
+		" -z                Compress the -o file with gzip.\n"
+		" -V                Report memory use on stderr when done.\n"
+		" -K                Annotate 65816 code with estimated CPU cycles and master\n"
+		"                     clocks, and give each basic block's total. (see readme.)\n"
+		" -H <count>        Trace code (as -c) and list the <count> most expensive\n"
+		"                     loops instead of disassembling. (see readme.)\n"
+		" -N <countfile>    Rank -H loops by execution counts from an emulator.\n"
+		" -O <profile>      Lay out lines to a profile, e.g. \"addr=colon,hex=0x,upper,\n"
+		"                     cols\": address style, hex prefix, mnemonic case and\n"
+		"                     fixed columns. (see readme.)\n"
+		" -M <mapfile>      Trace code (as -c) and save the read/write/exec map.\n"
+		" -X <steps>        Trace code (as -c), then also run it from each entry point\n"
+		"                     for up to <steps> instructions and trace what that\n"
+		"                     reaches. (see readme.)\n"
+		" -D <format>       Output data as hex (default), db, dw, dl, ptr or lptr: the\n"
+		"                     untraced bytes with -c/-C, or else the whole range.\n"
+		" -T <tblfile>      Output text in data through a character table (see readme.)\n"
+		" -R <regionfile>   Output the code and data regions listed in a file, in\n"
+		"                     address order. Overrides -b/-r. (see readme.)\n"
+		" -C <cdlfile>      Take code, entry points and A/X/Y sizes from an emulator\n"
+		"                     code/data log. Unlogged bytes are output as hex.\n"
+		" -P <cpu>          Disassemble code for 65816 (default), 6502, 65c02, spc700\n"
+		"                     or superfx.\n"
+		" -U                Find the sound CPU's uploads and list them as SPC700 code\n"
+		"                     at their APU RAM addresses. (see readme.)\n"
+		" -Q                Trace code (as -c), then answer disasm/xrefs/label requests\n"
+		"                     on stdin instead of listing. (see readme.)\n"
+		" -F <pattern>      List the addresses of an instruction sequence, e.g.\n"
+		"                     \"lda #*; sta $420B\", instead of disassembling.\n"
+		"                     (see readme.)\n"
+		" -L <sigfile>      Trace code (as -c) and name the routines whose fingerprints\n"
+		"                     are in <sigfile>. (see readme.)\n"
+		" -W <sigfile>      Trace code (as -c) and add the fingerprints of the named\n"
+		"                     code regions (see -R) to <sigfile>.\n"
+		" <infile>          File to disassemble, which may be gzip-compressed.\n");
 }
 
-/* Snes9x Hi/LoROM autodetect code */
+/* blockoffs() - converts a block of SNES addresses to file offsets
+ * Pre:  start/end - first and last address of the block; end may be NOADDR
+ * Post: start/end - first and last mapped file offsets within the block;
+ *       an end of NOADDR is left alone.
+ *       returns -1 if nothing in the block is mapped, or 0.
+ */
 
-int AllASCII(unsigned char *b, int size)
+static int blockoffs(struct mapper *map, unsigned long *start, unsigned long *end)
 {
-	int i;
-	for (i = 0; i < size; i++)
+	long soff,eoff;
+
+	// On the HiROM mappers, banks below $40 are taken as file offsets
+	if (map->type == MAP_HIROM || map->type == MAP_EXHIROM)
 	{
-		if (b[i] < 32 || b[i] > 126)
+		if (!(*start & 0x400000))
 		{
-			return 0;
+			*start |= (map->type == MAP_HIROM) ? 0x400000 : 0xC00000;
+		}
+		if (*end != NOADDR && !(*end & 0x400000))
+		{
+			*end |= (map->type == MAP_HIROM) ? 0x400000 : 0xC00000;
 		}
 	}
-	return 1;
-}
-
-int ScoreHiROM(unsigned char *data)
-{
-	int score = 0;
-
-	if ((data[0xFFDC] + data[0xFFDD]*256 + data[0xFFDE] + data[0xFFDF]*256) == 0xFFFF)
-	{
-		score += 2;
-	}
-	
-	if (data[0xFFDA] == 0x33)
-	{
-		score += 2;
-	}
-	if ((data[0xFFD5] & 0xf) < 4)
-	{
-		score += 2;
-	}
-	if (!(data[0xFFFD] & 0x80))
-	{
-		score -= 4;
-	}
-	if ((1 << (data[0xFFD7] - 7)) > 48)
-	{
-		score -= 1;
-	}
-	if (!AllASCII(&data[0xFFB0], 6))
-	{
-		score -= 1;
-	}
-	if (!AllASCII(&data[0xFFC0], 20))
-	{
-		score -= 1;
-	}
-	
-	return (score);
-}
-
-int ScoreLoROM(unsigned char *data)
-{
-	int score = 0;
 
-	if ((data[0x7FDC] + data[0x7FDD]*256 + data[0x7FDE] + data[0x7FDF]*256) == 0xFFFF)
-	{
-		score += 2;
-	}
-	if (data[0x7FDA] == 0x33)
-	{
-		score += 2;
-	}
-	if ((data[0x7FD5] & 0xf) < 4)
-	{
-		score += 2;
-	}
-	if (!(data[0x7FFD] & 0x80))
-	{
-		score -= 4;
-	}
-	if ((1 << (data[0x7FD7] - 7)) > 48)
-	{
-		score -= 1;
-	}
-	if (!AllASCII(&data[0x7FB0], 6))
+	soff = mapfirst(map, *start, (*end != NOADDR) ? *end : 0xFFFFFF);
+	eoff = (*end != NOADDR) ? maplast(map, *end, *start) : 0;
+	if (soff < 0 || eoff < 0)
 	{
-		score -= 1;
+		return -1;
 	}
-	if (!AllASCII(&data[0x7FC0], 20))
+	*start = soff;
+	if (*end != NOADDR)
 	{
-		score -= 1;
+		*end = eoff;
 	}
-
-	return (score);
+	return 0;
 }
 
-int hexdump(unsigned char *data,unsigned long pos,unsigned long rpos,
-			unsigned long len,char *inst, unsigned char dwidth)
+static int regioncmp(const void *a, const void *b)
 {
-	int i;
+	unsigned long sa = ((const struct region *)a)->start, sb = ((const struct region *)b)->start;
 
-	sprintf(inst, "%02lX/%04lX:\t", (pos >> 16) & 0xFF, pos & 0xFFFF);
-	for(i=0; i<dwidth && i+rpos<len; i++)
-	{
-		sprintf(inst + i*2 + 9, "%02X", data[rpos+i]);
-	}
-	return dwidth;
+	return (sa > sb) - (sa < sb);
 }
 
 int main(int argc, char *argv[])
 {
 	FILE *fin,*fout;
-	char infile[BUFSIZ],outfile[BUFSIZ],inst[521];
-	unsigned char dmem[4],flag=0,*data;
-	unsigned long len,pos=0,origin=0x1000000,start=0,end=0,rpos;
-	unsigned char opt,skip=0,hirom=2,shadow=2,bound=1,tsrc=0;
-	unsigned int offset,bank=0x100,i,tmp,dwidth=0;
-	int hiscore,loscore;
+	char infile[BUFSIZ],outfile[BUFSIZ],mapfile[BUFSIZ],cdlfile[BUFSIZ],tblfile[BUFSIZ],regfile[BUFSIZ],srcfile[BUFSIZ],sigfile[BUFSIZ],newsigs[BUFSIZ],cntfile[BUFSIZ];
+	unsigned char *data,*cmap=NULL,*raw;
+	struct analysis an;
+	unsigned short flag=0;
+	unsigned long len,origin=0x1000000,steps=0,found=0,hot=0;
+	unsigned char opt,shadow=2,bound=1,tsrc=0,tracing=0,ranged=0,spcscan=0,serving=0,finding=0,zipped=0,memstats=0,profiled=0,costs=0;
+	unsigned int i,dwidth=0,vec;
+	int nentry=0,mapping=-1,dformat=DF_HEX,nregion,nblock,r,n,cputag=RT_CODE,nrange=0,rangesize=0;
+	long hdr,voff,skip=-1;
+	struct mapper map;
+	struct romhead hd;
+	struct entry *entry;
+	struct region *region,*block,*range=NULL;
+	struct execrun run;
+	struct listing ls;
+	struct pattern pat;
+	struct profile prof;
 
 	outfile[0]=0;
+	mapfile[0]=0;
+	cdlfile[0]=0;
+	tblfile[0]=0;
+	regfile[0]=0;
+	srcfile[0]=0;
+	sigfile[0]=0;
+	newsigs[0]=0;
+	cntfile[0]=0;
 
 	// Parse the commandline
 
@@ -174,16 +187,25 @@ int main(int argc, char *argv[])
 		switch(opt)
 		{
 		case 'n':
-			skip = 1;
+			skip = 0x200;
 			break;
 		case 't':
 			tsrc |= 1;
 			break;
 		case 'h':
-			hirom = 1;
+			mapping = MAP_HIROM;
 			break;
 		case 'l':
-			hirom = 0;
+			mapping = MAP_LOROM;
+			break;
+		case 'm':
+			i++;
+			if ((mapping = mapname(argv[i])) < 0)
+			{
+				usage();
+				printf("\n-m requires one of lorom, hirom, exhirom, exlorom, sa1 or superfx after it.\n");
+				exit(1);
+			}
 			break;
 		case 's':
 			shadow = 1;
@@ -197,12 +219,57 @@ int main(int argc, char *argv[])
 		case 'x':
 			flag |= 0x10;
 			break;
+		case 'E':
+			flag |= FLAG_E | 0x30;
+			break;
 		case 'e':
 			bound = 0;
 			break;
 		case 'p':
 			tsrc |= 2;
 			break;
+		case 'S':
+			tsrc |= 5;
+			break;
+		case 'c':
+			tracing = 1;
+			break;
+		case 'U':
+			spcscan = 1;
+			break;
+		case 'Q':
+			serving = 1;
+			tracing = 1;
+			break;
+		case 'F':
+			i++;
+			if (compilepat(argv[i], &pat) < 0)
+			{
+				usage();
+				printf("\n-F requires an instruction pattern (up to 16 instructions) after it.\n");
+				exit(1);
+			}
+			finding = 1;
+			break;
+		case 'O':
+			i++;
+			if (compileprofile(argv[i], &prof) < 0)
+			{
+				usage();
+				printf("\n-O requires an output profile after it (see readme.)\n");
+				exit(1);
+			}
+			profiled = 1;
+			break;
+		case 'P':
+			i++;
+			if ((cputag = cputype(argv[i])) == 0)
+			{
+				usage();
+				printf("\n-P requires one of 65816, 6502, 65c02, spc700 or superfx after it.\n");
+				exit(1);
+			}
+			break;
 		case 'd':
 			i++;
 			if ((sscanf(argv[i], "%2X", &dwidth) == 0) || dwidth==0)
@@ -214,21 +281,22 @@ int main(int argc, char *argv[])
 			break;
 		case 'b':
 			i++;
-			if (sscanf(argv[i], "%2X", &bank) == 0)
+			if (parseblocks(argv[i], 1, &range, &nrange, &rangesize) < 0)
 			{
 				usage();
-				printf("\n-b requires a 1-byte hex value after it.\n");
+				printf("\n-b requires 1-byte hex values, separated by commas, after it.\n");
 				exit(1);
 			}
 			break;
 		case 'r':
 			i++;
-			if (sscanf(argv[i], "%6lX-%6lX", &start, &end) == 0)
+			if (parseblocks(argv[i], 0, &range, &nrange, &rangesize) < 0)
 			{
 				usage();
-				printf("\n-a requires at least one hex value after it.\n");
+				printf("\n-r requires hex ranges, separated by commas, after it.\n");
 				exit(1);
 			}
+			ranged = 1;
 			break;
 		case 'g':
 			i++;
@@ -243,6 +311,88 @@ int main(int argc, char *argv[])
 			i++;
 			strcpy(outfile, argv[i]);
 			break;
+		case 'z':
+			zipped = 1;
+			break;
+		case 'V':
+			memstats = 1;
+			break;
+		case 'K':
+			costs = 1;
+			break;
+		case 'M':
+			i++;
+			strcpy(mapfile, argv[i]);
+			tracing = 1;
+			break;
+		case 'C':
+			i++;
+			strcpy(cdlfile, argv[i]);
+			break;
+		case 'L':
+			i++;
+			strcpy(sigfile, argv[i]);
+			tracing = 1;
+			break;
+		case 'W':
+			i++;
+			strcpy(newsigs, argv[i]);
+			tracing = 1;
+			break;
+		case 'H':
+			i++;
+			if (sscanf(argv[i], "%lX", &hot) == 0 || hot == 0)
+			{
+				usage();
+				printf("\n-H requires a hex loop count after it.\n");
+				exit(1);
+			}
+			tracing = 1;
+			break;
+		case 'N':
+			i++;
+			strcpy(cntfile, argv[i]);
+			break;
+		case 'X':
+			i++;
+			if (sscanf(argv[i], "%lX", &steps) == 0 || steps == 0)
+			{
+				usage();
+				printf("\n-X requires a hex step count after it.\n");
+				exit(1);
+			}
+			tracing = 1;
+			break;
+		case 'D':
+			i++;
+			if ((dformat = dataformat(argv[i])) < 0)
+			{
+				usage();
+				printf("\n-D requires one of hex, db, dw, dl, ptr or lptr after it.\n");
+				exit(1);
+			}
+			break;
+		case 'T':
+			i++;
+			strcpy(tblfile, argv[i]);
+			break;
+		case 'R':
+			i++;
+			strcpy(regfile, argv[i]);
+			break;
+		case 'A':
+			i++;
+			strcpy(srcfile, argv[i]);
+			break;
+		case 'G':
+			// The ROM is the last argument, so this is the last option
+			i++;
+			if (maketest(argv[i]) < 0)
+			{
+				printf("Cannot write test ROM %s.\n", argv[i]);
+				exit(1);
+			}
+			return 0;
 		default:
 			usage();
 			printf("\nUnknown option: -%c\n", opt);
@@ -259,21 +409,59 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	// Set up the output
-	if (outfile[0] == 0)
+	// Set up the output. Patched images are written at the end.
+	if (srcfile[0])
+	{
+		if (outfile[0] == 0)
+		{
+			usage();
+			printf("\n-A requires -o for the patched image.\n");
+			exit(1);
+		}
+		fout = NULL;
+	}
+	else if (outfile[0] == 0 || serving)
 	{
 		strcpy(outfile,"STDOUT");
 		fout = stdout;
 	}
 	else
 	{
-		fout = fopen(outfile, "w");
+		fout = zipped ? zopen(outfile) : fopen(outfile, "w");
 		if (!fout)
 		{
 			printf("Cannot open %s for writing.\n",outfile);
 			exit(1);
 		}
 	}
+	if (zipped && fout == stdout)
+	{
+		usage();
+		printf("\n-z requires -o for the compressed listing.\n");
+		exit(1);
+	}
+
+	// Assembler source is all instructions and db lines, and strings would
+	// need the assembler to have the same table
+	if (tsrc & 4)
+	{
+		dwidth = 0;
+		tblfile[0] = 0;
+	}
+
+	// Text goes out as db lines unless something else was asked for
+	if (tblfile[0])
+	{
+		if (loadtbl(tblfile) < 0)
+		{
+			printf("Cannot open %s for reading.\n", tblfile);
+			exit(1);
+		}
+		if (dformat == DF_HEX)
+		{
+			dformat = DF_BYTE;
+		}
+	}
 
 	// Read the file into memory
 #ifndef _WIN32
@@ -284,71 +472,70 @@ int main(int argc, char *argv[])
 	len = filelength(fileno(fin));
 #endif
 
-	// Make sure the image is big enough
-
-	if (len < 0x8000 || (skip == 1 && len < 0x8200))
+	// Allocate mem for file. Decoding stops at the end of it, so no padding
+	if ((data = malloc(len ? len : 1)) == NULL)
 	{
-		printf("This file looks too small to be a legitimate rom image.\n");
-	}
-
-	// Allocate mem for file. Extra 3 bytes to prevent segfault during memcpy
-	if ((data = malloc(len+3)) == NULL)
-	{
-		printf("Cant alloc %ld bytes.\n", len+3);
+		printf("Cant alloc %ld bytes.\n", len);
 		exit(1);
 	}
-	if (skip)
-	{
-		len -= 0x200;
-		fread(data, 0x200, 1, fin);
-	}
-	
 	fread(data, len, 1, fin);
 	fclose(fin);
 
-	// Autodetect the HiROM/LoROM state
-
-	if (hirom==2)
+	// Compressed images are unpacked whole
+	if (len >= 2 && data[0] == 0x1F && data[1] == 0x8B)
 	{
-		hiscore = ScoreHiROM(data);
-		loscore = ScoreLoROM(data);
-		if (hiscore>loscore)
-		{
-//			fprintf(stderr,"Autodetected HiROM image.\n");
-			hirom = 1;
-		}
-		else
+		if ((raw = gunzip(data, len, &len)) == NULL)
 		{
-//			fprintf(stderr,"Autodetected LoROM image.\n");
-			hirom = 0;
+			printf("%s looks gzip-compressed, but can't be unpacked.\n", infile);
+			exit(1);
 		}
+		free(data);
+		data = raw;
 	}
 
-	// Unmangle the address options
+	// Find the header, which sets the memory map and copier header skip
+	detect(data, len, skip, mapping, &hd);
+	mapping = hd.mapping;
+	data += hd.skip;
+	len -= hd.skip;
 
-	pos = start;
+	// Make sure the image is big enough
 
-	// If shadow addresses given, convert to unshadowed and set shadow on.
-	if ((bank == 0x100 && start & 0x800000) | (bank & 0x80))
+	if (hd.header < 0)
 	{
-		shadow = 1;
+		printf("This file looks too small to be a legitimate rom image.\n");
 	}
-	
-	// If HiROM addresses given, convert to normal and set hirom on.
-	if ((bank == 0x100 && start & 0x400000) | (bank & 0x40))
+
+	// Images too big for the plain maps need the extended ones
+	if (len > 0x400000 && (mapping == MAP_HIROM || mapping == MAP_LOROM))
+	{
+		mapping = (mapping == MAP_HIROM) ? MAP_EXHIROM : MAP_EXLOROM;
+	}
+
+	// Unmangle the address options
+
+	for (r=0; r<nrange; r++)
 	{
-		hirom=1;
+		// If shadow addresses given, set shadow on.
+		if (range[r].start & 0x800000)
+		{
+			shadow = 1;
+		}
+
+		// If HiROM addresses given, set hirom on.
+		if (mapping == MAP_LOROM && (range[r].start & 0x400000))
+		{
+			mapping = MAP_HIROM;
+		}
 	}
-	bank &= 0x13F;
-	start &= 0x3FFFFF;
-	end &= 0x3FFFFF;
 
 	// Autodetect shadow
 
+	hdr = mapheader(mapping);
 	if(shadow == 2)
 	{
-//		fprintf(stderr,"%02X\n",data[hirom?0xFFD5:0x7FD5]);
-		if(data[hirom?0xFFD5:0x7FD5] & 0x30)
+//		fprintf(stderr,"%02X\n",data[hdr+0x15]);
+		if(hdr + 0x15 < len && data[hdr+0x15] & 0x30)
 		{
 			shadow=1;
 		}
@@ -358,63 +545,192 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	// If the bank byte is set, apply it to the address range
-	if (bank < 0x100)
+	mapinit(&map, mapping, len, shadow);
+
+	// Patch the image and write it back out, copier header and all
+	if (srcfile[0])
 	{
-		if(hirom)
+		if (asmfile(srcfile, data, len, &map) < 0)
 		{
-			pos = bank << 16;
-			start = pos;
-			end = start | 0xFFFF;
+			exit(1);
 		}
-		else
+		if ((fout = fopen(outfile, "wb")) == NULL || fwrite(data - hd.skip, len + hd.skip, 1, fout) != 1)
 		{
-			pos = (bank << 16) + 0x8000;
-			start = bank * 0x8000;
-			end = start + 0x7FFF;
+			printf("Cannot write %s.\n", outfile);
+			exit(1);
 		}
+		fclose(fout);
+		mapfree(&map);
+		return 0;
 	}
-	else
+
+	// Without -b or -r, the whole image
+	if (nrange == 0)
+	{
+		parseblocks("0", 0, &range, &nrange, &rangesize);
+	}
+
+	// Convert the blocks to file offsets, in order, merging any that overlap.
+	// Blocks the image doesn't map are dropped.
+	for (r=0,n=0; r<nrange; r++)
+	{
+		if (range[r].end == NOADDR)
+		{
+			range[r].end = 0xFFFFFF;
+		}
+		if (blockoffs(&map, &range[r].start, &range[r].end) < 0)
+		{
+			continue;
+		}
+
+		// If end isn't after start, set end to end-of-file.
+		if (range[r].end <= range[r].start)
+		{
+			range[r].end = len-1;
+		}
+		range[n] = range[r];
+		range[n].type = (dformat != DF_HEX && !tracing && !cdlfile[0]) ? dformat : cputag;
+		range[n].flag = flag;
+		range[n].origin = 0x1000000;
+		range[n].name[0] = 0;
+		n++;
+	}
+	nrange = n;
+	qsort(range, nrange, sizeof(struct region), regioncmp);
+	nrange = mergeregions(range, nrange);
+	if (nrange > 0)
+	{
+		range[0].origin = origin;
+	}
+
+	// Without a region file, the blocks are the regions
+	if (regfile[0])
 	{
-		if(!hirom)
+		free(range);
+		if ((nregion = loadregions(regfile, flag, &region)) < 0)
+		{
+			printf("Cannot load region file %s.\n", regfile);
+			exit(1);
+		}
+		for (r=0,n=0; r<nregion; r++)
 		{
-			// Convert the addresses to offsets
-			if ((start & 0xFFFF) < 0x8000)
+			if (blockoffs(&map, &region[r].start, &region[r].end) == 0)
 			{
-				start += 0x8000;
+				region[n++] = region[r];
 			}
-			pos = start;
-			start = ((start >> 16) & 0xFF) * 0x8000 + (start & 0x7FFF);
-			end = ((end >> 16) & 0xFF) * 0x8000 + (end & 0x7FFF);
 		}
-	}
+		nregion = n;
+		qsort(region, nregion, sizeof(struct region), regioncmp);
 
-	// If end isn't after start, set end to end-of-file.
-	if(end <= start)
+		// Open-ended regions run up to the next one
+		for (r=0; r<nregion; r++)
+		{
+			if (region[r].end == NOADDR)
+			{
+				region[r].end = (r + 1 < nregion) ? region[r+1].start - 1 : len - 1;
+			}
+		}
+	}
+	else
 	{
-		end = len-1;
+		region = range;
+		nregion = nrange;
 	}
 
-	// If new origin set, apply it.
-	if (origin<0x1000000)
+	// Take the code map from a log, and/or trace the code reachable from the
+	// vectors and the start of the range
+	if ((tracing || cdlfile[0]) && dwidth == 0)
 	{
-		pos=origin;
+		aninit(&an, len);
+		cmap = an.cmap;
+		if (cdlfile[0] && loadcdl(&an, data, len, &map, cdlfile) < 0)
+		{
+			printf("Cannot load code/data log %s, or it doesn't match the image.\n", cdlfile);
+			exit(1);
+		}
 	}
-
-	// If shadow set, apply it
-	if (shadow)
+	if (tracing && dwidth == 0)
 	{
-		pos |= 0x800000;
+		if ((entry = malloc((16 + nregion) * sizeof(struct entry))) == NULL)
+		{
+			printf("Cant alloc trace entries.\n");
+			exit(1);
+		}
+
+		// Native COP,BRK,ABORT,NMI,-,IRQ then emulation COP,-,ABORT,NMI,RESET,IRQ
+		for (vec=0xFFE4; vec<0x10000; vec+=2)
+		{
+			voff = snes2off(&map, vec);
+			if (voff >= 0 && voff + 1 < len && data[voff] + data[voff+1]*256 >= 0x8000)
+			{
+				entry[nentry].addr = data[voff] + data[voff+1]*256;
+				entry[nentry].flag = (vec >= 0xFFF4) ? (FLAG_E | 0x30) : (flag & ~FLAG_E);
+				// Reset clears D and DBR; the interrupts can't assume anything
+				entry[nentry].ctx = (vec == 0xFFFC) ? (CTX_D | CTX_DBR) : 0;
+				nentry++;
+			}
+		}
+		// ...and the start of the range, or of each code region
+		for (r=0; r<nregion && (ranged || regfile[0]); r++)
+		{
+			if (region[r].type == RT_CODE && (entry[nentry].addr = off2snes(&map, region[r].start)) != NOADDR)
+			{
+				entry[nentry].flag = region[r].flag;
+				entry[nentry].ctx = 0;
+				nentry++;
+			}
+		}
+		trace(&an, data, len, &map, entry, nentry);
+
+		// Running the code finds what it computes its way to
+		if (steps)
+		{
+			execute(&an, data, len, &map, entry, nentry, steps, &run);
+			if (run.nfound)
+			{
+				trace(&an, data, len, &map, run.found, run.nfound);
+			}
+			fprintf(stderr, "Execution: %lu steps, %d new entry points, %lu instructions at other widths.\n",
+				run.steps, run.nfound, run.conflicts);
+			free(run.found);
+		}
+		free(entry);
+
+		// Known routines get their names
+		if (sigfile[0])
+		{
+			if (loadsigs(sigfile) < 0)
+			{
+				printf("Cannot load fingerprints from %s.\n", sigfile);
+				exit(1);
+			}
+			nblock = namesigs(&an, data, len, &map, region, nregion, &block);
+			if (nblock > 0)
+			{
+				nregion = splitregions(&region, nregion, block, nblock);
+			}
+			fprintf(stderr, "Fingerprints: %d routines named.\n", nblock);
+			free(block);
+			freesigs();
+		}
+		if (newsigs[0] && savesigs(&an, data, len, region, nregion, newsigs) < 0)
+		{
+			printf("Cannot write fingerprints to %s.\n", newsigs);
+		}
 	}
 
-	// If hirom, apply the mapping
-	if (hirom)
+	// Sound CPU uploads take over the code they were taken for
+	if (spcscan)
 	{
-		pos |= 0x400000;
+		if ((nblock = spcfind(data, len, &block)) > 0)
+		{
+			nregion = splitregions(&region, nregion, block, nblock);
+		}
+		free(block);
 	}
 
 #ifdef _DEBUG
-	fprintf(stderr,"Start: $%06X End: $%06X Pos: $%06X\n", start, end, pos);
+	fprintf(stderr,"Start: $%06lX End: $%06lX Pos: $%06lX\n", region[0].start, region[0].end, off2snes(&map, region[0].start));
 	fprintf(stderr,"Input: %s\nOutput: %s\n", infile, outfile);
 	if(shadow)
 	{
@@ -426,78 +742,92 @@ int main(int argc, char *argv[])
 	}
 #endif
 
-	// Begin disassembly
-
-	rpos = start;
-
-	while (rpos < len && rpos <= end)
-	{
-		// copy some data to the staging area
-		memcpy(dmem, data+rpos, 4);
-
-		// disassemble one instruction, or produce one line of hexdump
-		if (dwidth == 0)
+	ls.fout = fout;
+	ls.data = data;
+	ls.len = len;
+	ls.map = &map;
+	ls.an = (cmap != NULL) ? &an : NULL;
+	ls.tsrc = tsrc;
+	ls.bound = bound;
+	ls.dwidth = dwidth;
+	ls.dformat = dformat;
+	ls.checked = ls.differ = 0;
+	ls.profile = profiled ? &prof : NULL;
+	ls.cycles = costs;
+	ls.fast = shadow;
+	ls.region = region;
+	ls.nregion = nregion;
+
+	// Requests get pieces of the listing, instead of the whole thing
+	if (serving)
+	{
+		serve(&ls, region, nregion);
+	}
+	else if (hot)
+	{
+		if (cntfile[0] && loadcounts(cntfile, &map, len) < 0)
 		{
-			offset = disasm(dmem, pos, &flag, inst, tsrc);
+			printf("Cannot read execution counts from %s.\n", cntfile);
+			exit(1);
 		}
-		else
+		fprintf(stderr, "Loops: %lu found.\n", hotloops(&ls, hot));
+		freecounts();
+	}
+	else if (finding)
+	{
+		// Only 65816 code is searched
+		for (r=0; r<nregion; r++)
 		{
-			offset = hexdump(data, pos, rpos, len, inst, dwidth);
+			if (region[r].type == RT_CODE)
+			{
+				found += search(&ls, &region[r], &pat);
+			}
 		}
+		fprintf(stderr, "Search: %lu matches.\n", found);
+	}
+	else
+	{
+		// Begin disassembly, one region at a time
 
-		// Check for a file/block overrun
-		if ((rpos + offset) > len || (rpos + offset) > (end+1))
+		if (tsrc & 4)
 		{
-			// print out remaining bytes and finish
-			fprintf(fout,"%02lX/%04lX:\t", (pos >> 16) & 0xFF, pos & 0xFFFF);
-			for (i=rpos; i<len && i<=end; i++)
-			{
-				fprintf(fout,"%02X", data[rpos]);
-			}
-			fprintf(fout,"\n");
-			break;
+			fprintf(fout, "%s\n", mapasm(mapping));
 		}
 
-		// Check for a bank overrun
-		if (bound && ((pos & 0xFFFF) + offset) > 0x10000)
+		for (r=0; r<nregion; r++)
 		{
-			// print out remaining bytes
-			fprintf(fout, "%02lX/%04lX:\t",(pos >> 16) & 0xFF, pos & 0xFFFF);
-			tmp = 0x10000 - (pos & 0xFFFF);
-			for (i=0; i<tmp; i++)
-			{
-				fprintf(fout, "%02X", data[rpos+i]);
-			}
-			fprintf(fout, "\n");
-			// Move to next bank
-			if(!hirom)
-			{
-				pos = (pos & 0xFF0000) + 0x18000;
-			}
-			else
-			{
-				pos += tmp;
-			}
-			rpos += tmp;
-			continue;
+			listregion(&ls, &region[r]);
 		}
+	}
 
-		fprintf(fout, "%s\n", inst);
-		
-		// Move to next instruction
-		if (!hirom && ((pos & 0xFFFF) + offset) > 0xFFFF)
+	if (tsrc & 4)
+	{
+		fprintf(stderr, "Reassembly check: %lu bytes, %lu lines differ.\n", ls.checked, ls.differ);
+	}
+
+	fclose(fout);
+	free(region);
+	mapfree(&map);
+	if (memstats)
+	{
+		fprintf(stderr, "Memory: %ld K peak resident", peakrss());
+		if (cmap != NULL)
 		{
-			pos = (pos & 0xFF0000) + 0x18000;
+			fprintf(stderr, ", analysis %lu K in %d blocks (%lu K used), %.3fs allocating",
+				an.arena.size / 1024, an.arena.nblock, an.arena.used / 1024, an.arena.secs);
 		}
-		else
+		fprintf(stderr, ".\n");
+	}
+	if (cmap != NULL)
+	{
+		if (mapfile[0] && savemap(&an, mapfile) < 0)
 		{
-			pos += offset;
+			printf("Cannot write access map to %s.\n", mapfile);
 		}
-		rpos+=offset;
+		anfree(&an);
 	}
+	freetbl();
 
-	fclose(fout);
-
-	return 0;
+	return ls.differ ? 1 : 0;
 }
 
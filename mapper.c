@@ -0,0 +1,314 @@
+/* mapper.c
+ * Memory mapper module for DisPel
+ * Converts between SNES addresses and file offsets using per-bank lookup
+ * tables, built once per image for each cartridge layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+static const char *mapnames[MAP_COUNT] =
+{
+	"lorom", "hirom", "exhirom", "exlorom", "sa1", "superfx"
+};
+
+// Assembler directives that select each mapper
+static const char *mapdirs[MAP_COUNT] =
+{
+	"lorom", "hirom", "exhirom", "exlorom", "sa1rom", "sfxrom"
+};
+
+/* mapname() - looks up a mapper by name
+ * Pre:  name - mapper name, e.g. "hirom"
+ * Post: returns the MAP_* type, or -1 if the name is unknown.
+ */
+
+int mapname(const char *name)
+{
+	int i;
+
+	for (i=0; i<MAP_COUNT; i++)
+	{
+		if (strcmp(name, mapnames[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char *maptitle(int type)
+{
+	return (type >= 0 && type < MAP_COUNT) ? mapnames[type] : "unknown";
+}
+
+/* mapdirective() - looks up a mapper by its assembler directive
+ * Post: returns the MAP_* type, or -1 if name isn't one.
+ */
+
+int mapdirective(const char *name)
+{
+	int i;
+
+	for (i=0; i<MAP_COUNT; i++)
+	{
+		if (strcmp(name, mapdirs[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+const char *mapasm(int type)
+{
+	return (type >= 0 && type < MAP_COUNT) ? mapdirs[type] : "norom";
+}
+
+/* bankbase() - file offset of one 32K half-bank
+ * Pre:  type - MAP_* type
+ *       half - SNES address >> 15 (bank * 2, +1 for $8000-$FFFF)
+ * Post: returns the file offset of the half-bank, or -1 if it isn't ROM.
+ */
+
+static long bankbase(int type, unsigned int half)
+{
+	unsigned int bank = half >> 1, upper = half & 1;
+
+	// WRAM is never ROM
+	if (bank == 0x7E || bank == 0x7F)
+	{
+		return -1;
+	}
+
+	switch (type)
+	{
+	case MAP_LOROM:
+		if (!upper)
+		{
+			return -1;
+		}
+		return (long)(bank & 0x7F) * 0x8000;
+	case MAP_HIROM:
+		if (!upper && !(bank & 0x40))
+		{
+			return -1;
+		}
+		return (long)(bank & 0x3F) * 0x10000 + upper * 0x8000;
+	case MAP_EXHIROM:
+		if (!upper && !(bank & 0x40))
+		{
+			return -1;
+		}
+		// Banks $C0-$FF hold the first 4MB, $40-$7D the rest
+		return (bank & 0x80 ? 0 : 0x400000) + (long)(bank & 0x3F) * 0x10000 + upper * 0x8000;
+	case MAP_EXLOROM:
+		if (!upper)
+		{
+			return -1;
+		}
+		// Banks $80-$FF hold the first 4MB, $00-$7D the rest
+		return (bank & 0x80 ? 0 : 0x400000) + (long)(bank & 0x7F) * 0x8000;
+	case MAP_SA1:
+		// Default Super MMC setup: $00-$3F/$80-$BF as LoROM over 1MB
+		// blocks 0-3, $C0-$FF as HiROM over the whole image
+		if (bank >= 0xC0)
+		{
+			return (long)(bank & 0x3F) * 0x10000 + upper * 0x8000;
+		}
+		if (!upper || (bank & 0x40))
+		{
+			return -1;
+		}
+		return (bank & 0x80 ? 0x200000 : 0) + (long)(bank & 0x3F) * 0x8000;
+	case MAP_SUPERFX:
+		// $00-$3F/$80-$BF as LoROM, $40-$5F/$C0-$DF as HiROM over 2MB
+		if ((bank & 0x7F) < 0x40)
+		{
+			return upper ? (long)(bank & 0x3F) * 0x8000 : -1;
+		}
+		if ((bank & 0x7F) < 0x60)
+		{
+			return (long)(bank & 0x1F) * 0x10000 + upper * 0x8000;
+		}
+		return -1;
+	}
+	return -1;
+}
+
+/* mapheader() - file offset of the cartridge header
+ * Post: returns the offset that $00:FFC0 maps to under this mapper.
+ */
+
+long mapheader(int type)
+{
+	return bankbase(type, 1) + 0x7FC0;
+}
+
+/* mapscore() - ranks the mirrors of a ROM chunk for listing addresses
+ * Post: higher is better. FastROM or SlowROM banks are preferred as
+ *       requested, then the full HiROM banks on HiROM-style mappers and
+ *       the LoROM banks on the coprocessor mappers.
+ */
+
+static int mapscore(int type, unsigned long addr, int shadow)
+{
+	int score = 0;
+
+	if (((addr & 0x800000) != 0) == (shadow != 0))
+	{
+		score += 1;
+	}
+	if ((type == MAP_HIROM || type == MAP_EXHIROM) && (addr & 0x400000))
+	{
+		score += 2;
+	}
+	if ((type == MAP_SA1 || type == MAP_SUPERFX) && !(addr & 0x400000))
+	{
+		score += 2;
+	}
+	return score;
+}
+
+/* mapinit() - builds the lookup tables for an image
+ * Pre:  map    - mapper to initialise
+ *       type   - MAP_* type
+ *       len    - image length
+ *       shadow - 1 if listing addresses should use the FastROM banks
+ * Post: map is ready for snes2off()/off2snes(). Call mapfree() when done.
+ */
+
+void mapinit(struct mapper *map, int type, unsigned long len, int shadow)
+{
+	unsigned int half;
+	unsigned long chunk,addr;
+	long base;
+
+	map->type = type;
+	map->len = len;
+	map->nrev = (len + 0x7FFF) >> 15;
+	if ((map->rev = malloc(map->nrev * sizeof(unsigned long) + 1)) == NULL)
+	{
+		printf("Cant alloc mapper tables.\n");
+		exit(1);
+	}
+	for (chunk=0; chunk<map->nrev; chunk++)
+	{
+		map->rev[chunk] = NOADDR;
+	}
+
+	for (half=0; half<512; half++)
+	{
+		base = bankbase(type, half);
+		if (base < 0 || (unsigned long)base >= len)
+		{
+			map->fwd[half] = -1;
+			continue;
+		}
+		map->fwd[half] = base;
+
+		// The reverse table keeps the best scoring address for each chunk
+		addr = (unsigned long)half << 15;
+		chunk = base >> 15;
+		if (map->rev[chunk] == NOADDR || mapscore(type, addr, shadow) > mapscore(type, map->rev[chunk], shadow))
+		{
+			map->rev[chunk] = addr;
+		}
+	}
+}
+
+void mapfree(struct mapper *map)
+{
+	free(map->rev);
+	map->rev = NULL;
+}
+
+/* snes2off() - converts a SNES address to a file offset
+ * Post: returns the file offset, or -1 if addr isn't ROM in this image.
+ */
+
+long snes2off(struct mapper *map, unsigned long addr)
+{
+	long base = map->fwd[(addr >> 15) & 0x1FF];
+
+	return base < 0 ? -1 : base + (long)(addr & 0x7FFF);
+}
+
+/* off2snes() - converts a file offset to its listing address
+ * Post: returns the SNES address, or NOADDR if the offset isn't mapped.
+ */
+
+unsigned long off2snes(struct mapper *map, unsigned long off)
+{
+	unsigned long base;
+
+	if ((off >> 15) >= map->nrev || (base = map->rev[off >> 15]) == NOADDR)
+	{
+		return NOADDR;
+	}
+	return base | (off & 0x7FFF);
+}
+
+/* mapfirst()/maplast() - nearest mapped file offset to an address
+ * Pre:  addr       - SNES address, which needn't be ROM
+ *       last/first - the other end of the span to look in
+ * Post: returns the offset of the first mapped byte from addr up to last
+ *       (or the last one from addr down to first), or -1 if there isn't
+ *       one in the span.
+ */
+
+long mapfirst(struct mapper *map, unsigned long addr, unsigned long last)
+{
+	unsigned int half;
+
+	addr &= 0xFFFFFF;
+	last &= 0xFFFFFF;
+	if (addr > last)
+	{
+		return -1;
+	}
+	for (half=addr >> 15; half<=(last >> 15); half++, addr=(unsigned long)half << 15)
+	{
+		// The last half-bank may only be partly in the image
+		if (map->fwd[half] >= 0 && (unsigned long)map->fwd[half] + (addr & 0x7FFF) < map->len)
+		{
+			return map->fwd[half] + (long)(addr & 0x7FFF);
+		}
+	}
+	return -1;
+}
+
+long maplast(struct mapper *map, unsigned long addr, unsigned long first)
+{
+	unsigned long off;
+	int half;
+
+	addr &= 0xFFFFFF;
+	first &= 0xFFFFFF;
+	if (addr < first)
+	{
+		return -1;
+	}
+	for (half=addr >> 15; half>=(int)(first >> 15); half--, addr=((unsigned long)half << 15) | 0x7FFF)
+	{
+		if (map->fwd[half] < 0)
+		{
+			continue;
+		}
+		off = map->fwd[half] + (addr & 0x7FFF);
+		if (off >= map->len)
+		{
+			off = map->len - 1;
+		}
+		// Nothing of the half-bank from first on is in the image
+		if ((unsigned long)half == (first >> 15) && off < map->fwd[half] + (first & 0x7FFF))
+		{
+			return -1;
+		}
+		return off;
+	}
+	return -1;
+}
@@ -0,0 +1,308 @@
+/* query.c
+ * Query module for DisPel
+ * Answers requests on stdin against an image that's already been loaded
+ * and traced, so an editor can ask for small pieces of the listing
+ * without a new process each time. Each request is one line; each reply
+ * is any number of lines followed by a line holding just ".".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// One reference: the address referred to, and the file offset of the
+// instruction or jump table entry referring to it
+struct xref
+{
+	unsigned long to;
+	unsigned long from;
+};
+
+static struct xref *xrefs = NULL;
+static unsigned long nxref = 0;
+
+/* canon() - one address for all the ways of reaching a byte
+ * Post: returns the listing address of ROM addresses, and the folded
+ *       address (see foldaddr()) of anything else.
+ */
+
+static unsigned long canon(struct listing *ls, unsigned long addr)
+{
+	long off = snes2off(ls->map, addr & 0xFFFFFF);
+
+	return (off >= 0 && (unsigned long)off < ls->len) ? off2snes(ls->map, off) : foldaddr(addr);
+}
+
+/* refers() - the address an instruction refers to
+ * Pre:  mem - the instruction
+ *       pc  - its address
+ *       ctx - its D/DBR context
+ * Post: returns the branch, call or jump target, the pointer of an
+ *       indirect jump, or the data address the operand resolves to
+ *       (see effaddr()); -1 if there isn't one.
+ */
+
+static long refers(unsigned char *mem, unsigned long pc, unsigned long ctx)
+{
+	unsigned long bank = pc & 0xFF0000, operand = mem[1] | (mem[2] << 8);
+
+	switch (opmode[mem[0]])
+	{
+	case AM_REL:
+		return bank | ((pc + 2 + (signed char)mem[1]) & 0xFFFF);
+	case AM_RELL:
+		return bank | ((pc + 3 + (short)operand) & 0xFFFF);
+	case AM_LONG:
+	case AM_LONGX:
+		return operand | (mem[3] << 16);
+	case AM_ABSIND:
+	case AM_ABSINDL:
+		return operand;
+	case AM_ABSINDX:
+		return bank | operand;
+	case AM_ABS:
+		// JMP/JSR abs are code addresses in the program bank
+		if (mem[0] == 0x20 || mem[0] == 0x4C)
+		{
+			return bank | operand;
+		}
+	}
+	return effaddr(mem, ctx);
+}
+
+static int xrefcmp(const void *a, const void *b)
+{
+	const struct xref *xa = a, *xb = b;
+
+	if (xa->to != xb->to)
+	{
+		return (xa->to > xb->to) - (xa->to < xb->to);
+	}
+	return (xa->from > xb->from) - (xa->from < xb->from);
+}
+
+/* buildxrefs() - indexes the references made by the traced code
+ * Post: xrefs holds every reference, sorted by the canonical address
+ *       referred to. It's allocated from the analysis' arena, with room
+ *       for one reference per instruction or table entry.
+ */
+
+static void buildxrefs(struct listing *ls)
+{
+	unsigned char *cmap = ls->an->cmap, mem[4];
+	unsigned long off,size = 0,pc;
+	long to;
+
+	for (off=0; off<ls->len; off++)
+	{
+		size += (cmap[off] & (CM_OP|CM_PTR)) != 0;
+	}
+	xrefs = aalloc(&ls->an->arena, (size + 1) * sizeof(struct xref));
+
+	for (off=0; off<ls->len; off++)
+	{
+		if (cmap[off] & CM_OP)
+		{
+			memset(mem, 0, 4);
+			memcpy(mem, ls->data+off, (ls->len-off) < 4 ? (ls->len-off) : 4);
+			pc = off2snes(ls->map, off);
+			to = refers(mem, pc, ls->an->ctx[off]);
+		}
+		else if ((cmap[off] & CM_PTR) && ls->an->ctx[off])
+		{
+			to = ls->an->ctx[off];
+		}
+		else
+		{
+			continue;
+		}
+		if (to < 0)
+		{
+			continue;
+		}
+		xrefs[nxref].to = canon(ls, to);
+		xrefs[nxref].from = off;
+		nxref++;
+	}
+	qsort(xrefs, nxref, sizeof(struct xref), xrefcmp);
+}
+
+/* listpiece() - lists the part of a region between two file offsets */
+
+static void listpiece(struct listing *ls, struct region *rg, unsigned long start, unsigned long end)
+{
+	struct region p = *rg;
+
+	p.start = (start > rg->start) ? start : rg->start;
+	p.end = (end < rg->end) ? end : rg->end;
+	if (p.start > p.end)
+	{
+		return;
+	}
+	if (p.origin < 0x1000000)
+	{
+		p.origin += p.start - rg->start;
+	}
+	if (p.start != rg->start)
+	{
+		p.name[0] = 0;
+	}
+	listregion(ls, &p);
+}
+
+/* qdisasm() - "disasm <start>[-<end>]": the listing of a range of addresses */
+
+static void qdisasm(struct listing *ls, struct region *region, int nregion, const char *args)
+{
+	unsigned long start,end = NOADDR;
+	long soff,eoff;
+	int r;
+
+	if (sscanf(args, "%lX-%lX", &start, &end) < 1)
+	{
+		fprintf(ls->fout, "? disasm requires a hex address or range.\n");
+		return;
+	}
+	if (end == NOADDR)
+	{
+		end = start;
+	}
+
+	// Nothing mapped in the span, or it's backwards
+	soff = mapfirst(ls->map, start, end);
+	eoff = maplast(ls->map, end, start);
+	if (soff < 0 || eoff < 0 || eoff < soff)
+	{
+		fprintf(ls->fout, "? nothing in the image at $%06lX-$%06lX.\n", start, end);
+		return;
+	}
+	for (r=0; r<nregion; r++)
+	{
+		listpiece(ls, &region[r], soff, eoff);
+	}
+}
+
+/* qxrefs() - "xrefs <addr>": the instructions and jump table entries that
+ * refer to an address
+ */
+
+static void qxrefs(struct listing *ls, const char *args)
+{
+	struct region rg;
+	unsigned long addr,lo,hi,mid,off;
+
+	if (sscanf(args, "%lX", &addr) < 1)
+	{
+		fprintf(ls->fout, "? xrefs requires a hex address.\n");
+		return;
+	}
+	if (ls->an == NULL)
+	{
+		fprintf(ls->fout, "? no code was traced.\n");
+		return;
+	}
+	addr = canon(ls, addr);
+
+	// First reference to the address, if any
+	for (lo=0, hi=nxref; lo<hi; )
+	{
+		mid = (lo + hi) / 2;
+		if (xrefs[mid].to < addr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	rg.type = RT_CODE;
+	rg.flag = 0;
+	rg.origin = 0x1000000;
+	rg.name[0] = 0;
+	for (; lo<nxref && xrefs[lo].to == addr; lo++)
+	{
+		off = xrefs[lo].from;
+		rg.start = off;
+		rg.end = off + ((ls->an->cmap[off] & CM_OP) ? oplen[OPSTATE(ls->an->cmap[off])][ls->data[off]] : 2) - 1;
+		listregion(ls, &rg);
+	}
+}
+
+/* qlabel() - "label <addr>": the name of the code at an address, from the
+ * region file, or made up for the start of a traced region or target
+ */
+
+static void qlabel(struct listing *ls, const char *args)
+{
+	unsigned long addr;
+	char name[40];
+	long off;
+
+	if (sscanf(args, "%lX", &addr) < 1)
+	{
+		fprintf(ls->fout, "? label requires a hex address.\n");
+		return;
+	}
+	off = snes2off(ls->map, addr & 0xFFFFFF);
+	if (off >= 0 && (unsigned long)off < ls->len && addrlabel(ls, off, name))
+	{
+		fprintf(ls->fout, "%s\n", name);
+	}
+}
+
+/* serve() - answers requests until end of input or "quit"
+ * Pre:  ls      - output options, as for the full listing
+ *       region  - regions of the image, with file offsets
+ *       nregion - number of regions
+ * Post: each request is answered on ls->fout, which is flushed after
+ *       every reply. Nothing in the image or the analysis is changed.
+ */
+
+void serve(struct listing *ls, struct region *region, int nregion)
+{
+	char line[256],cmd[16],*args;
+
+	if (ls->an != NULL)
+	{
+		buildxrefs(ls);
+	}
+
+	while (fgets(line, sizeof(line), stdin) != NULL)
+	{
+		if (sscanf(line, "%15s", cmd) < 1)
+		{
+			continue;
+		}
+		args = strstr(line, cmd) + strlen(cmd);
+
+		if (strcmp(cmd, "quit") == 0)
+		{
+			break;
+		}
+		else if (strcmp(cmd, "disasm") == 0)
+		{
+			qdisasm(ls, region, nregion, args);
+		}
+		else if (strcmp(cmd, "xrefs") == 0)
+		{
+			qxrefs(ls, args);
+		}
+		else if (strcmp(cmd, "label") == 0)
+		{
+			qlabel(ls, args);
+		}
+		else
+		{
+			fprintf(ls->fout, "? unknown request: %s\n", cmd);
+		}
+		fprintf(ls->fout, ".\n");
+		fflush(ls->fout);
+	}
+
+	xrefs = NULL;
+	nxref = 0;
+}
@@ -0,0 +1,274 @@
+/* region.c
+ * Region file module for DisPel
+ * Reads the list of address ranges to output, each with its own type,
+ * starting processor state, origin and label, and cuts found regions into
+ * them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+/* parseregion() - reads one region line
+ * Pre:  line - text of the line, "<start>[-<end>] <type> [a|x|ax|E]
+ *              [@<origin>] [<label>]". The flags are only read as flags
+ *              straight after the type, so a label like "ax" can follow.
+ *       flag - processor state to start code with if the line doesn't say
+ * Post: returns 1 and fills in r, 0 for blank and comment lines, or -1
+ *       if the line can't be understood.
+ */
+
+static int parseregion(char *line, unsigned short flag, struct region *r)
+{
+	char *tok;
+	int n,first;
+
+	if ((tok = strtok(line, " \t\r\n")) == NULL || tok[0] == '#' || tok[0] == ';')
+	{
+		return 0;
+	}
+
+	r->end = NOADDR;
+	if ((n = sscanf(tok, "%6lX-%6lX", &r->start, &r->end)) < 1)
+	{
+		return -1;
+	}
+
+	if ((tok = strtok(NULL, " \t\r\n")) == NULL)
+	{
+		return -1;
+	}
+	if (strcmp(tok, "data") == 0)
+	{
+		r->type = DF_BYTE;
+	}
+	else if ((r->type = cputype(tok)) == 0 && (r->type = dataformat(tok)) < 0)
+	{
+		return -1;
+	}
+
+	r->flag = flag;
+	r->origin = 0x1000000;
+	r->name[0] = 0;
+	for (first=1; (tok = strtok(NULL, " \t\r\n")) != NULL; first=0)
+	{
+		if (tok[0] == '@')
+		{
+			if (sscanf(tok + 1, "%6lX", &r->origin) < 1)
+			{
+				return -1;
+			}
+		}
+		else if (first && strspn(tok, "axE") == strlen(tok))
+		{
+			// Flags given replace the default ones
+			r->flag = 0;
+			for (; *tok; tok++)
+			{
+				r->flag |= (*tok == 'a') ? 0x20 : (*tok == 'x') ? 0x10 : (FLAG_E | 0x30);
+			}
+		}
+		else
+		{
+			strncpy(r->name, tok, sizeof(r->name) - 1);
+			r->name[sizeof(r->name) - 1] = 0;
+		}
+	}
+	return 1;
+}
+
+/* loadregions() - reads a region file
+ * Pre:  file - name of the region file
+ *       flag - processor state to start code with where a line doesn't say
+ * Post: returns the number of regions read into *list (free() it when
+ *       done), or -1 if the file couldn't be read or has a bad line.
+ *       Addresses are left as given, in the file's order. Regions without
+ *       an end address have end NOADDR.
+ */
+
+int loadregions(const char *file, unsigned short flag, struct region **list)
+{
+	FILE *f;
+	char line[256];
+	int n=0,size=0,lineno=0,res;
+
+	if ((f = fopen(file, "r")) == NULL)
+	{
+		return -1;
+	}
+
+	*list = NULL;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		lineno++;
+		if (n == size)
+		{
+			size = size ? size * 2 : 64;
+			if ((*list = realloc(*list, size * sizeof(struct region))) == NULL)
+			{
+				printf("Cant alloc region list.\n");
+				exit(1);
+			}
+		}
+		if ((res = parseregion(line, flag, *list + n)) < 0)
+		{
+			printf("%s(%d): can't understand this region.\n", file, lineno);
+			fclose(f);
+			free(*list);
+			*list = NULL;
+			return -1;
+		}
+		n += res;
+	}
+	fclose(f);
+	return n;
+}
+
+/* addregion() - appends a region to a list, growing it as needed */
+
+static void addregion(struct region **list, int *n, int *size, const struct region *r)
+{
+	if (*n == *size)
+	{
+		*size = *size ? *size * 2 : 64;
+		if ((*list = realloc(*list, *size * sizeof(struct region))) == NULL)
+		{
+			printf("Cant alloc region list.\n");
+			exit(1);
+		}
+	}
+	(*list)[(*n)++] = *r;
+}
+
+/* parseblocks() - reads the blocks given to -r or -b
+ * Pre:  text - comma-separated "<start>[-<end>]" addresses, or bank
+ *              numbers if bank is 1
+ *       list/n/size - blocks so far, see addregion()
+ * Post: the blocks are added to the list, as SNES addresses, end NOADDR
+ *       if not given. Only start and end are filled in.
+ *       returns 0, or -1 if a block isn't hex.
+ */
+
+int parseblocks(const char *text, int bank, struct region **list, int *n, int *size)
+{
+	struct region r;
+	const char *p;
+
+	memset(&r, 0, sizeof(struct region));
+	for (p=text; *p; p+=strcspn(p, ","), p+=(*p == ','))
+	{
+		r.end = NOADDR;
+		if (bank)
+		{
+			if (sscanf(p, "%2lX", &r.start) < 1)
+			{
+				return -1;
+			}
+			r.start <<= 16;
+			r.end = r.start | 0xFFFF;
+		}
+		else if (sscanf(p, "%6lX-%6lX", &r.start, &r.end) < 1)
+		{
+			return -1;
+		}
+		addregion(list, n, size, &r);
+	}
+	return (*n > 0) ? 0 : -1;
+}
+
+/* mergeregions() - merges overlapping and adjacent regions
+ * Pre:  list - regions in file offsets, sorted by start
+ * Post: returns the number of regions left. Each takes its type, state
+ *       and origin from the first of those merged into it.
+ */
+
+int mergeregions(struct region *list, int n)
+{
+	int i,m;
+
+	for (i=1, m=(n > 0); i<n; i++)
+	{
+		if (list[i].start <= list[m-1].end + 1)
+		{
+			list[m-1].end = (list[i].end > list[m-1].end) ? list[i].end : list[m-1].end;
+		}
+		else
+		{
+			list[m++] = list[i];
+		}
+	}
+	return m;
+}
+
+/* piece() - the part of a region from one file offset to another */
+
+static struct region piece(const struct region *r, unsigned long start, unsigned long end)
+{
+	struct region p = *r;
+
+	p.start = start;
+	p.end = end;
+	if (r->origin < 0x1000000)
+	{
+		p.origin = r->origin + (start - r->start);
+	}
+	if (start != r->start)
+	{
+		p.name[0] = 0;
+	}
+	return p;
+}
+
+/* splitregions() - cuts other regions into the code regions
+ * Pre:  list - regions in file offsets, sorted and not overlapping
+ *       cut  - regions to cut in, the same
+ * Post: returns the number of regions now in *list. The parts of 65816
+ *       code regions covered by cut regions become those regions; others,
+ *       and cut regions outside code, are left as they were.
+ */
+
+int splitregions(struct region **list, int n, struct region *cut, int ncut)
+{
+	struct region *out=NULL,*r,p;
+	unsigned long at;
+	int m=0,size=0,i,c;
+
+	for (i=0; i<n; i++)
+	{
+		r = *list + i;
+		if (r->type != RT_CODE)
+		{
+			addregion(&out, &m, &size, r);
+			continue;
+		}
+
+		at = r->start;
+		for (c=0; c<ncut && at<=r->end; c++)
+		{
+			if (cut[c].end < at || cut[c].start > r->end)
+			{
+				continue;
+			}
+			if (cut[c].start > at)
+			{
+				p = piece(r, at, cut[c].start - 1);
+				addregion(&out, &m, &size, &p);
+				at = cut[c].start;
+			}
+			p = piece(cut + c, at, (cut[c].end < r->end) ? cut[c].end : r->end);
+			addregion(&out, &m, &size, &p);
+			at = p.end + 1;
+		}
+		if (at <= r->end)
+		{
+			p = piece(r, at, r->end);
+			addregion(&out, &m, &size, &p);
+		}
+	}
+
+	free(*list);
+	*list = out;
+	return m;
+}
@@ -0,0 +1,262 @@
+/* spc700.c
+ * SPC700 module for DisPel
+ * Disassembles the sound CPU's code, and finds the blocks a game uploads
+ * to APU RAM through the IPL boot ROM.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dispel.h"
+
+// Smallest upload (all blocks together) that's believed
+#define MINUPLOAD	256
+// Most blocks in one upload
+#define MAXBLOCKS	32
+// Furthest the start address is from the start of its block - drivers
+// start with their setup code
+#define MAXENTRY	256
+
+/* Instruction lengths */
+
+const unsigned char spclen[256] =
+{
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 1,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 3, 3,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 2,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 2, 3,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 2,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 3, 3,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 3, 1,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 2, 1,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 3,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 1, 1,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 1,
+	2, 1, 2, 3, 2, 3, 3, 2, 3, 1, 2, 2, 1, 1, 1, 1,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 2, 1, 1,
+	2, 1, 2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 3, 1,
+	1, 1, 2, 3, 2, 3, 1, 2, 2, 3, 3, 2, 3, 1, 1, 1,
+	2, 1, 2, 3, 2, 3, 3, 2, 2, 2, 3, 2, 1, 1, 2, 1,
+};
+
+/* Mnemonic of each opcode */
+
+const char spcname[256][6] =
+{
+	"nop", "tcall", "set1", "bbs", "or", "or", "or", "or", "or", "or", "or1", "asl", "asl", "push", "tset1", "brk",
+	"bpl", "tcall", "clr1", "bbc", "or", "or", "or", "or", "or", "or", "decw", "asl", "asl", "dec", "cmp", "jmp",
+	"clrp", "tcall", "set1", "bbs", "and", "and", "and", "and", "and", "and", "or1", "rol", "rol", "push", "cbne", "bra",
+	"bmi", "tcall", "clr1", "bbc", "and", "and", "and", "and", "and", "and", "incw", "rol", "rol", "inc", "cmp", "call",
+	"setp", "tcall", "set1", "bbs", "eor", "eor", "eor", "eor", "eor", "eor", "and1", "lsr", "lsr", "push", "tclr1", "pcall",
+	"bvc", "tcall", "clr1", "bbc", "eor", "eor", "eor", "eor", "eor", "eor", "cmpw", "lsr", "lsr", "mov", "cmp", "jmp",
+	"clrc", "tcall", "set1", "bbs", "cmp", "cmp", "cmp", "cmp", "cmp", "cmp", "and1", "ror", "ror", "push", "dbnz", "ret",
+	"bvs", "tcall", "clr1", "bbc", "cmp", "cmp", "cmp", "cmp", "cmp", "cmp", "addw", "ror", "ror", "mov", "cmp", "reti",
+	"setc", "tcall", "set1", "bbs", "adc", "adc", "adc", "adc", "adc", "adc", "eor1", "dec", "dec", "mov", "pop", "mov",
+	"bcc", "tcall", "clr1", "bbc", "adc", "adc", "adc", "adc", "adc", "adc", "subw", "dec", "dec", "mov", "div", "xcn",
+	"ei", "tcall", "set1", "bbs", "sbc", "sbc", "sbc", "sbc", "sbc", "sbc", "mov1", "inc", "inc", "cmp", "pop", "mov",
+	"bcs", "tcall", "clr1", "bbc", "sbc", "sbc", "sbc", "sbc", "sbc", "sbc", "movw", "inc", "inc", "mov", "das", "mov",
+	"di", "tcall", "set1", "bbs", "mov", "mov", "mov", "mov", "cmp", "mov", "mov1", "mov", "mov", "mov", "pop", "mul",
+	"bne", "tcall", "clr1", "bbc", "mov", "mov", "mov", "mov", "mov", "mov", "movw", "mov", "dec", "mov", "cbne", "daa",
+	"clrv", "tcall", "set1", "bbs", "mov", "mov", "mov", "mov", "mov", "mov", "not1", "mov", "mov", "notc", "pop", "sleep",
+	"beq", "tcall", "clr1", "bbc", "mov", "mov", "mov", "mov", "mov", "mov", "mov", "mov", "inc", "mov", "dbnz", "stop",
+};
+
+/* Operands of each opcode. Lower case letters stand for the operand bytes:
+ * d - direct page (first byte), e - direct page (second byte), i - immediate,
+ * w - absolute, m - absolute.bit, u - $FFxx (PCALL), r - branch target
+ * (last byte). Everything else is output as it is.
+ */
+
+static const char spcargs[256][10] =
+{
+	"", "0", "d.0", "d.0,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,m", "d", "w", "PSW", "w", "",
+	"r", "1", "d.0", "d.0,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "d", "d+X", "A", "X", "X,w", "[w+X]",
+	"", "2", "d.1", "d.1,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,/m", "d", "w", "A", "d,r", "r",
+	"r", "3", "d.1", "d.1,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "d", "d+X", "A", "X", "X,d", "w",
+	"", "4", "d.2", "d.2,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,m", "d", "w", "X", "w", "u",
+	"r", "5", "d.2", "d.2,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "YA,d", "d+X", "A", "X,A", "Y,w", "w",
+	"", "6", "d.3", "d.3,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,/m", "d", "w", "Y", "d,r", "",
+	"r", "7", "d.3", "d.3,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "YA,d", "d+X", "A", "A,X", "Y,d", "",
+	"", "8", "d.4", "d.4,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,m", "d", "w", "Y,i", "PSW", "e,i",
+	"r", "9", "d.4", "d.4,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "YA,d", "d+X", "A", "X,SP", "YA,X", "A",
+	"", "10", "d.5", "d.5,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "e,d", "C,m", "d", "w", "Y,i", "A", "(X)+,A",
+	"r", "11", "d.5", "d.5,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "e,i", "(X),(Y)", "YA,d", "d+X", "A", "SP,X", "A", "A,(X)+",
+	"", "12", "d.6", "d.6,r", "d,A", "w,A", "(X),A", "[d+X],A", "X,i", "w,X", "m,C", "d,Y", "w,Y", "X,i", "X", "YA",
+	"r", "13", "d.6", "d.6,r", "d+X,A", "w+X,A", "w+Y,A", "[d]+Y,A", "d,X", "d+Y,X", "d,YA", "d+X,Y", "Y", "A,Y", "d+X,r", "A",
+	"", "14", "d.7", "d.7,r", "A,d", "A,w", "A,(X)", "A,[d+X]", "A,i", "X,w", "m", "Y,d", "Y,w", "", "Y", "",
+	"r", "15", "d.7", "d.7,r", "A,d+X", "A,w+X", "A,w+Y", "A,[d]+Y", "X,d", "X,d+Y", "e,d", "Y,d+X", "Y", "Y,A", "Y,r", "",
+};
+
+/* spcscan() - walks SPC700 instruction boundaries, as scan() does */
+
+unsigned long spcscan(unsigned char *data, unsigned long rpos, unsigned long end, unsigned short *flag,
+	unsigned char *marks)
+{
+	while (rpos < end)
+	{
+		if (marks != NULL)
+		{
+			marks[rpos] |= CM_OP;
+		}
+		rpos += spclen[data[rpos]];
+	}
+	return rpos;
+}
+
+/* spcdisasm() - disassembles a single SPC700 instruction
+ * Pre:  mem   - pointer to memory for disassembly
+ *       pos   - APU RAM address of the instruction
+ *       flag  - unused; the SPC700 has no state that changes decoding
+ *       tsrc  - as for disasm(), see fmtline()
+ * Post: inst  - disassembled instruction
+ *       returns number of bytes to advance, or 0 if truncated (see disasm()).
+ */
+
+int spcdisasm(unsigned char *mem, unsigned long avail, unsigned long pos, unsigned short *flag, char *inst,
+	unsigned char tsrc)
+{
+	char pbuf[24],*p;
+	const char *a;
+	int offset,sval;
+
+	if (avail == 0 || (unsigned long)(offset = spclen[mem[0]]) > avail)
+	{
+		return 0;
+	}
+
+	// Fill in the operand template
+	p = pbuf;
+	for (a = spcargs[mem[0]]; *a; a++)
+	{
+		switch (*a)
+		{
+		case 'd':
+			p += sprintf(p, "$%02X", mem[1]);
+			break;
+		case 'e':
+			p += sprintf(p, "$%02X", mem[2]);
+			break;
+		case 'i':
+			p += sprintf(p, "#$%02X", mem[1]);
+			break;
+		case 'w':
+			p += sprintf(p, "$%04X", mem[1] + mem[2]*256);
+			break;
+		case 'm':
+			p += sprintf(p, "$%04X.%d", (mem[1] + mem[2]*256) & 0x1FFF, mem[2] >> 5);
+			break;
+		case 'u':
+			p += sprintf(p, "$FF%02X", mem[1]);
+			break;
+		case 'r':
+			sval = (mem[offset-1]>127) ? (mem[offset-1]-256) : mem[offset-1];
+			p += sprintf(p, "$%04lX", (pos+sval+offset) & 0xFFFF);
+			break;
+		default:
+			*p++ = *a;
+		}
+	}
+	*p = 0;
+
+	fmtline(mem, pos, offset, spcname[mem[0]], pbuf, inst, tsrc);
+	if ((tsrc & 2) && (mem[0] == 0x6F || mem[0] == 0x7F))
+	{
+		strcat(inst, "\n");
+	}
+
+	return offset;
+}
+
+/* spcfind() - finds the uploads to APU RAM in an image
+ * Pre:  data - ROM image
+ *       len  - image length
+ * Post: returns the number of regions put in *list (free() it when done).
+ *       An upload is the IPL loader's chain of blocks - a length word and
+ *       an APU RAM address word, then the bytes - ended by a zero length
+ *       and the address to start at. For every upload whose start
+ *       address falls near the start of one of its blocks, the
+ *       length/address words come back as dw regions, the block holding
+ *       the start address as an RT_SPC region and the other blocks as db,
+ *       all in file offsets with the blocks given their APU RAM addresses
+ *       as origins.
+ */
+
+int spcfind(unsigned char *data, unsigned long len, struct region **list)
+{
+	unsigned long off,o,blen,addr,total,run;
+	unsigned long bstart[MAXBLOCKS],baddr[MAXBLOCKS],bsize[MAXBLOCKS];
+	int n=0,size=0,nb,b,need,code;
+
+	*list = NULL;
+	for (off=0; off+4<=len; off++)
+	{
+		// Follow the chain as far as it goes
+		for (o=off, nb=0, total=0; o+4<=len && nb<MAXBLOCKS; o+=4+blen, nb++)
+		{
+			blen = data[o] | (data[o+1] << 8);
+			addr = data[o+2] | (data[o+3] << 8);
+			// Blocks can't wrap, run off the image or land on the I/O ports
+			if (blen == 0 || addr + blen > 0x10000 || o + 4 + blen > len ||
+				(addr < 0x100 && addr + blen > 0xF0))
+			{
+				break;
+			}
+			bstart[nb] = o + 4;
+			baddr[nb] = addr;
+			bsize[nb] = blen;
+			total += blen;
+		}
+		if (nb == 0 || nb == MAXBLOCKS || o+4 > len || blen != 0 || total < MINUPLOAD)
+		{
+			continue;
+		}
+
+		// The start address has to be near the start of something that was
+		// uploaded
+		for (b=0; b<nb && (addr < baddr[b] || addr >= baddr[b] + bsize[b] || addr - baddr[b] >= MAXENTRY); b++);
+		if (b == nb)
+		{
+			continue;
+		}
+		code = b;
+
+		need = nb * 2 + 1;
+		if (n + need > size)
+		{
+			size = (n + need) * 2;
+			if ((*list = realloc(*list, size * sizeof(struct region))) == NULL)
+			{
+				printf("Cant alloc region list.\n");
+				exit(1);
+			}
+		}
+		for (b=0; b<=nb; b++)
+		{
+			// Length and address words, then the block
+			run = (b < nb) ? bstart[b] - 4 : o;
+			(*list)[n].start = run;
+			(*list)[n].end = run + 3;
+			(*list)[n].type = DF_WORD;
+			(*list)[n].flag = 0;
+			(*list)[n].origin = 0x1000000;
+			(*list)[n].name[0] = 0;
+			n++;
+			if (b == nb)
+			{
+				break;
+			}
+			(*list)[n].start = bstart[b];
+			(*list)[n].end = bstart[b] + bsize[b] - 1;
+			(*list)[n].type = (b == code) ? RT_SPC : DF_BYTE;
+			(*list)[n].flag = 0;
+			(*list)[n].origin = baddr[b];
+			(*list)[n].name[0] = 0;
+			n++;
+		}
+
+		// Carry on after the end of this upload
+		off = o + 3;
+	}
+	return n;
+}